@@ -0,0 +1,141 @@
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "EbnfBatch.h"
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QTextStream>
+#include <stdio.h>
+
+static void printUsage( QTextStream& out )
+{
+    out << "usage: EbnfBatch [options] file.ebnf..." << endl <<
+           "  -ambig     run the ambiguity analysis" << endl <<
+           "  -cpp       generate the C++ parser, token types and syntax tree" << endl <<
+           "  -visitor   generate the C++ visitor" << endl <<
+           "  -coco      generate the Coco/R grammar, token types and syntax tree" << endl <<
+           "  -antlr     generate the ANTLR grammar" << endl <<
+           "  -llgen     generate the LLgen grammar" << endl <<
+           "  -syntree   generate the syntax tree" << endl <<
+           "  -tt        generate the token types" << endl <<
+           "  -json      report diagnostics as JSON on stdout" << endl <<
+           "  -quiet     don't report warnings (text mode only)" << endl <<
+           "  -profile   report time, iterations and allocations per analysis phase" << endl <<
+           "exit code: 0 no errors, 1 grammar errors, 2 usage or file errors" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setOrganizationName("Rochus Keller");
+    a.setOrganizationDomain("github.com/rochus-keller/EbnfStudio");
+    a.setApplicationName("EbnfBatch");
+    a.setApplicationVersion("0.9.12");
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    EbnfBatch batch;
+    int gens = EbnfBatch::NoGen;
+    bool json = false;
+    bool quiet = false;
+    QStringList files;
+    const QStringList args = a.arguments();
+    for( int i = 1; i < args.size(); i++ ) // arg 0 enthält Anwendungspfad
+    {
+        const QString& arg = args[ i ];
+        if( arg == "-ambig" )
+            batch.setCheckAmbiguity(true);
+        else if( arg == "-cpp" )
+            gens |= EbnfBatch::GenCpp;
+        else if( arg == "-visitor" )
+            gens |= EbnfBatch::GenVisitor;
+        else if( arg == "-coco" )
+            gens |= EbnfBatch::GenCoco;
+        else if( arg == "-antlr" )
+            gens |= EbnfBatch::GenAntlr;
+        else if( arg == "-llgen" )
+            gens |= EbnfBatch::GenLlgen;
+        else if( arg == "-syntree" )
+            gens |= EbnfBatch::GenSynTree;
+        else if( arg == "-tt" )
+            gens |= EbnfBatch::GenTt;
+        else if( arg == "-json" )
+            json = true;
+        else if( arg == "-quiet" )
+            quiet = true;
+        else if( arg == "-profile" )
+            batch.setProfile(true);
+        else if( arg == "-h" || arg == "-help" || arg == "--help" )
+        {
+            printUsage(out);
+            return 0;
+        }else if( arg.startsWith('-') )
+        {
+            err << "unknown option " << arg << endl;
+            printUsage(err);
+            return 2;
+        }else
+            files << arg;
+    }
+    if( files.isEmpty() )
+    {
+        printUsage(err);
+        return 2;
+    }
+    batch.setGenerators(gens);
+
+    QList<EbnfBatch::Result> results;
+    bool hasErrors = false;
+    bool hasIoErrors = false;
+    foreach( const QString& path, files )
+    {
+        EbnfBatch::Result res = batch.process( QFileInfo(path).absoluteFilePath() );
+        res.d_path = path;
+        if( res.d_ioError )
+            hasIoErrors = true;
+        else if( res.hasErrors() )
+            hasErrors = true;
+        if( json )
+            results.append(res);
+        else
+        {
+            if( quiet )
+            {
+                EbnfBatch::Issues errsOnly;
+                foreach( const EbnfErrors::Entry& e, res.d_issues )
+                {
+                    if( e.d_isErr )
+                        errsOnly.append(e);
+                }
+                res.d_issues = errsOnly;
+            }
+            EbnfBatch::writeText( err, res );
+        }
+    }
+    if( json )
+        EbnfBatch::writeJson( out, results );
+
+    if( hasIoErrors )
+        return 2;
+    else if( hasErrors )
+        return 1;
+    else
+        return 0;
+}
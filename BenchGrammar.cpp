@@ -0,0 +1,169 @@
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "BenchGrammar.h"
+#include <QVector>
+#include <QList>
+
+static inline QByteArray prodName( quint32 i )
+{
+    return "P" + QByteArray::number(i);
+}
+
+static inline QByteArray termName( quint32 i )
+{
+    return "t" + QByteArray::number(i);
+}
+
+BenchGrammar::BenchGrammar(const Params& p):d_p(p),d_state(p.d_seed),d_terms(0)
+{
+    if( d_p.d_productions == 0 )
+        d_p.d_productions = 1;
+    if( d_p.d_fanOut == 0 )
+        d_p.d_fanOut = 1;
+}
+
+quint32 BenchGrammar::random(quint32 max)
+{
+    // own LCG instead of qrand so the grammars are the same on all platforms
+    d_state = d_state * 1103515245 + 12345;
+    if( max == 0 )
+        return 0;
+    return ( d_state >> 8 ) % max;
+}
+
+bool BenchGrammar::chance(quint32 percent)
+{
+    return random(100) < percent;
+}
+
+QByteArray BenchGrammar::generate()
+{
+    d_state = d_p.d_seed;
+    const quint32 n = d_p.d_productions;
+    d_terms = qMax( quint32(8), n / 2 );
+
+    // each cycle of length 1..3 adds an alternative to its members starting with the next member
+    QVector< QList<quint32> > leftRec( n );
+    for( quint32 c = 0; c < d_p.d_leftRec; c++ )
+    {
+        const quint32 len = qMin( c % 3 + 1, n );
+        const quint32 base = random( n - len + 1 );
+        for( quint32 k = 0; k < len; k++ )
+            leftRec[base + k].append( base + ( k + 1 ) % len );
+    }
+
+    QByteArray out;
+    out.reserve( n * 80 );
+    out += "// synthetic grammar: productions=" + QByteArray::number(n) +
+            " fanout=" + QByteArray::number(d_p.d_fanOut) +
+            " depth=" + QByteArray::number(d_p.d_depth) +
+            " nullable=" + QByteArray::number(d_p.d_nullable) +
+            " leftrec=" + QByteArray::number(d_p.d_leftRec) +
+            " predicates=" + QByteArray::number(d_p.d_predicates) +
+            " seed=" + QByteArray::number(d_p.d_seed) + "\n\n";
+
+    for( quint32 i = 0; i < n; i++ )
+    {
+        out += prodName(i) + " ::= ";
+        // the first alternative references the children in a binary tree so every production is reachable
+        out += termName( random(d_terms) );
+        if( 2 * i + 1 < n )
+            out += " " + prodName( 2 * i + 1 );
+        if( 2 * i + 2 < n )
+            out += " " + prodName( 2 * i + 2 );
+        const quint32 alts = random( d_p.d_fanOut );
+        for( quint32 a = 0; a < alts; a++ )
+        {
+            out += " | ";
+            if( chance( d_p.d_predicates ) )
+                out += "\\LL:" + QByteArray::number( 2 + random(2) ) + "\\ ";
+            sequence( out, i, 0, true );
+        }
+        foreach( quint32 to, leftRec[i] )
+            out += " | " + prodName(to) + " " + termName( random(d_terms) );
+        out += "\n";
+    }
+    out += "\n";
+    for( quint32 i = 0; i < d_terms; i++ )
+        out += termName(i) + " ::=\n";
+    return out;
+}
+
+void BenchGrammar::expression(QByteArray& out, quint32 prod, quint32 level)
+{
+    // groups get at least two alternatives, since e.g. [ { a } ] or ( [ a ] ) are rejected as
+    // contradicting nested quantifiers
+    const quint32 alts = qMax( 1 + random( d_p.d_fanOut ), quint32(2) );
+    for( quint32 a = 0; a < alts; a++ )
+    {
+        if( a != 0 )
+            out += " | ";
+        if( a != 0 && chance( d_p.d_predicates ) )
+            out += "\\LL:" + QByteArray::number( 2 + random(2) ) + "\\ ";
+        sequence( out, prod, level, true );
+    }
+}
+
+void BenchGrammar::sequence(QByteArray& out, quint32 prod, quint32 level, bool leading)
+{
+    const quint32 len = 1 + random(3);
+    for( quint32 i = 0; i < len; i++ )
+    {
+        if( i != 0 )
+            out += " ";
+        const int before = out.size();
+        factor( out, prod, level, leading );
+        // only a plain terminal ends the possibly left recursive prefix of the sequence
+        if( out.at(before) == 't' )
+            leading = false;
+    }
+}
+
+void BenchGrammar::factor(QByteArray& out, quint32 prod, quint32 level, bool leading)
+{
+    if( chance( d_p.d_nullable ) )
+    {
+        const bool rep = chance(50);
+        out += rep ? "{ " : "[ ";
+        if( level < d_p.d_depth && chance(30) )
+            expression( out, prod, level + 1 );
+        else
+            symbol( out, prod, leading );
+        out += rep ? " }" : " ]";
+    }else if( level < d_p.d_depth && chance(20) )
+    {
+        out += "( ";
+        expression( out, prod, level + 1 );
+        out += " )";
+    }else
+        symbol( out, prod, leading );
+}
+
+void BenchGrammar::symbol(QByteArray& out, quint32 prod, bool leading)
+{
+    const quint32 n = d_p.d_productions;
+    if( chance(50) || ( leading && prod + 1 >= n ) )
+        out += termName( random(d_terms) );
+    else if( leading )
+        // referencing only higher productions in leading position avoids unintended left recursion
+        out += prodName( prod + 1 + random( n - prod - 1 ) );
+    else
+        out += prodName( random(n) );
+}
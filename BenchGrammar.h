@@ -0,0 +1,59 @@
+#ifndef BENCHGRAMMAR_H
+#define BENCHGRAMMAR_H
+
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QByteArray>
+
+// Generates synthetic EBNF grammars of configurable size and shape for the EbnfBench tool.
+// The output only depends on the parameters (including the seed), not on the platform.
+class BenchGrammar
+{
+public:
+    struct Params
+    {
+        quint32 d_productions;  // number of nonterminal productions
+        quint32 d_fanOut;       // max. number of alternatives per production or group
+        quint32 d_depth;        // max. nesting depth of ( ), [ ] and { } groups
+        quint32 d_nullable;     // percentage of factors wrapped in [ ] or { }
+        quint32 d_leftRec;      // number of (direct or indirect) left recursion cycles
+        quint32 d_predicates;   // percentage of alternatives prefixed with \LL:k\ predicate
+        quint32 d_seed;
+        Params():d_productions(100),d_fanOut(4),d_depth(2),d_nullable(20),d_leftRec(0),
+            d_predicates(5),d_seed(1){}
+    };
+
+    explicit BenchGrammar( const Params& );
+    QByteArray generate();
+    quint32 getTerminalCount() const { return d_terms; }
+protected:
+    quint32 random( quint32 max ); // 0..max-1
+    bool chance( quint32 percent );
+    void expression( QByteArray& out, quint32 prod, quint32 level );
+    void sequence( QByteArray& out, quint32 prod, quint32 level, bool leading );
+    void factor( QByteArray& out, quint32 prod, quint32 level, bool leading );
+    void symbol( QByteArray& out, quint32 prod, bool leading );
+private:
+    Params d_p;
+    quint32 d_state;
+    quint32 d_terms;
+};
+
+#endif // BENCHGRAMMAR_H
@@ -0,0 +1,431 @@
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "BenchGrammar.h"
+#include "EbnfLexer.h"
+#include "EbnfParser.h"
+#include "EbnfSyntax.h"
+#include "EbnfErrors.h"
+#include "EbnfAnalyzer.h"
+#include "EbnfProfiler.h"
+#include "FirstFollowSet.h"
+#include "CppGen.h"
+#include <QCoreApplication>
+#include <QBuffer>
+#include <QFile>
+#include <QDir>
+#include <QStringList>
+#include <QTextStream>
+#include <algorithm>
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Peak resident memory in bytes; on Linux the peak is reset before each run, on the other
+// platforms it is the peak of the process so far, which is why the sizes are run in ascending order.
+static void resetPeakMemory()
+{
+#if defined(Q_OS_LINUX)
+    QFile f("/proc/self/clear_refs");
+    if( f.open(QIODevice::WriteOnly) )
+        f.write("5");
+#endif
+}
+
+static quint64 peakMemory()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if( GetProcessMemoryInfo( GetCurrentProcess(), &pmc, sizeof(pmc) ) )
+        return pmc.PeakWorkingSetSize;
+    return 0;
+#else
+#if defined(Q_OS_LINUX)
+    QFile f("/proc/self/status");
+    if( f.open(QIODevice::ReadOnly) )
+    {
+        while( !f.atEnd() )
+        {
+            const QByteArray line = f.readLine();
+            if( line.startsWith("VmHWM:") )
+                return line.mid(6).trimmed().split(' ').first().toULongLong() * 1024;
+        }
+    }
+#endif
+    struct rusage ru;
+    if( getrusage( RUSAGE_SELF, &ru ) != 0 )
+        return 0;
+#if defined(Q_OS_MAC)
+    return ru.ru_maxrss;
+#else
+    return quint64(ru.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+struct Run
+{
+    quint32 d_defs;
+    quint32 d_lines;
+    quint32 d_bytes;
+    quint32 d_issues;
+    quint64 d_peakMem;
+    qint64 d_total;
+    EbnfProfiler::Entries d_profile;
+    EbnfToken::SymPoolStats d_symPool;
+    quint32 d_nodes;
+    quint64 d_astBytes; // nodes, definitions and child arrays in the arena of the syntax
+    Run():d_defs(0),d_lines(0),d_bytes(0),d_issues(0),d_peakMem(0),d_total(0),d_nodes(0),d_astBytes(0){}
+};
+
+static Run runPipeline( const QByteArray& src, const QString& outDir, bool gen )
+{
+    Run r;
+    r.d_bytes = src.size();
+    r.d_lines = src.count('\n');
+
+    EbnfToken::resetSymTbl();
+    EbnfProfiler::reset();
+    EbnfProfiler::setEnabled(true);
+    resetPeakMemory();
+    QElapsedTimer timer;
+    timer.start();
+    {
+        EbnfErrors errs;
+        QBuffer in;
+        in.setData( src );
+        in.open(QIODevice::ReadOnly);
+        EbnfLexer lex;
+        lex.setStream( &in );
+        EbnfParser p;
+        p.setErrors(&errs);
+        if( p.parse( &lex ) )
+        {
+            EbnfSyntaxRef syn( p.getSyntax() );
+            if( syn->finishSyntax() )
+            {
+                FirstFollowSet tbl;
+                tbl.setSyntax( syn.data() );
+                EbnfAnalyzer::checkForAmbiguity( &tbl, &errs );
+                if( gen )
+                {
+                    EbnfProfiler::Scope prof("generate");
+                    CppGen g;
+                    g.generate( QDir(outDir).absoluteFilePath("Bench.atg"), syn.data(), &tbl );
+                }
+            }
+            r.d_defs = syn->getDefs().size();
+            r.d_symPool = EbnfToken::getSymPoolStats();
+            r.d_nodes = syn->getFlat().getNodeCount();
+            r.d_astBytes = syn->getArena().getUsed();
+        }
+        r.d_issues = errs.getErrors().size();
+    }
+    r.d_total = timer.nsecsElapsed();
+    r.d_peakMem = peakMemory();
+    r.d_profile = EbnfProfiler::getEntries();
+    EbnfProfiler::setEnabled(false);
+    return r;
+}
+
+static const EbnfProfiler::Entry& phase( const Run& r, const char* name )
+{
+    static const EbnfProfiler::Entry none;
+    for( int i = 0; i < r.d_profile.size(); i++ )
+    {
+        if( r.d_profile[i].d_detail.isEmpty() && r.d_profile[i].d_phase == name )
+            return r.d_profile[i];
+    }
+    return none;
+}
+
+static QString ms( qint64 nsecs )
+{
+    return QString::number( double(nsecs) / 1000000.0, 'f', 1 );
+}
+
+// appends a terminal to production Pn, i.e. changes one production like an edit in EbnfEditor
+static QByteArray editProduction( const QByteArray& src, quint32 n )
+{
+    const QByteArray name = "\nP" + QByteArray::number(n) + " ::=";
+    const int start = src.indexOf(name);
+    if( start == -1 )
+        return QByteArray();
+    int end = src.indexOf( '\n', start + 1 );
+    if( end == -1 )
+        end = src.size();
+    QByteArray res = src;
+    res.insert( end, " t0" );
+    return res;
+}
+
+static EbnfSyntaxRef parseSyntax( const QByteArray& src, EbnfErrors* errs )
+{
+    QBuffer in;
+    in.setData( src );
+    in.open(QIODevice::ReadOnly);
+    EbnfLexer lex;
+    lex.setStream( &in );
+    EbnfParser p;
+    p.setErrors(errs);
+    if( p.parse( &lex ) )
+        return EbnfSyntaxRef( p.getSyntax() );
+    return EbnfSyntaxRef();
+}
+
+// finishSyntax of the edited text, once with the original syntax as the previous version and once alone;
+// both must report the same issues
+static void runEdit( QTextStream& out, const QByteArray& src, quint32 n )
+{
+    const QByteArray edited = editProduction( src, n );
+    if( edited.isEmpty() )
+    {
+        out << "edit: there is no production P" << n << endl;
+        return;
+    }
+    EbnfToken::resetSymTbl();
+    EbnfErrors prevErrs;
+    EbnfSyntaxRef prev = parseSyntax( src, &prevErrs );
+    if( prev.constData() == 0 || !prev->finishSyntax() )
+    {
+        out << "edit: the grammar has errors" << endl;
+        return;
+    }
+    EbnfErrors incErrs, fullErrs;
+    EbnfSyntaxRef inc = parseSyntax( edited, &incErrs );
+    EbnfSyntaxRef full = parseSyntax( edited, &fullErrs );
+    if( inc.constData() == 0 || full.constData() == 0 )
+    {
+        out << "edit: the edited grammar has errors" << endl;
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    inc->finishSyntax( prev.data() );
+    const qint64 incTime = timer.nsecsElapsed();
+    timer.restart();
+    full->finishSyntax();
+    const qint64 fullTime = timer.nsecsElapsed();
+    out << QString("edit P%1: recomputed %2 of %3 productions, finishSyntax %4 ms (full %5 ms), issues %6")
+           .arg(n).arg(inc->getRecomputed()).arg(inc->getOrderedDefs().size()).arg(ms(incTime)).arg(ms(fullTime))
+           .arg( incErrs.getErrors() == fullErrs.getErrors() ? "same" : "DIFFERENT" ) << endl;
+}
+
+// the columns of the report; phases are the ones recorded by EbnfProfiler
+struct Column
+{
+    const char* d_phase;
+    const char* d_label;
+};
+static const Column s_timeCols[] = {
+    { "parse", "parse" }, { "finishSyntax", "finish" }, { "calculateNullable", "nullable" },
+    { "calculateFirstSets", "first" }, { "calculateFollowSets", "follow" },
+    { "checkForAmbiguity", "ambig" }, { "generate", "cppgen" } };
+static const int s_timeColCount = sizeof(s_timeCols) / sizeof(Column);
+
+static void writeTextHeader( QTextStream& out )
+{
+    out << QString("%1 %2 %3").arg("defs",7).arg("lines",7).arg("issues",7);
+    for( int i = 0; i < s_timeColCount; i++ )
+        out << QString(" %1").arg( s_timeCols[i].d_label, 10 );
+    out << QString(" %1 %2 %3 %4").arg("total ms",10).arg("it.null",7).arg("it.first",8).arg("it.follow",9);
+    out << QString(" %1 %2 %3 %4").arg("allocs",9).arg("B/node",6).arg("pool KB",8).arg("peak MB",8) << endl;
+}
+
+static void writeText( QTextStream& out, const Run& r )
+{
+    out << QString("%1 %2 %3").arg(r.d_defs,7).arg(r.d_lines,7).arg(r.d_issues,7);
+    for( int i = 0; i < s_timeColCount; i++ )
+        out << QString(" %1").arg( ms( phase(r,s_timeCols[i].d_phase).d_nsecs ), 10 );
+    out << QString(" %1").arg( ms(r.d_total), 10 );
+    out << QString(" %1 %2 %3").arg(phase(r,"calculateNullable").d_iterations,7)
+           .arg(phase(r,"calculateFirstSets").d_iterations,8).arg(phase(r,"calculateFollowSets").d_iterations,9);
+    out << QString(" %1 %2 %3 %4").arg(phase(r,"parse").d_allocs,9)
+           .arg( r.d_nodes ? QString::number( double(r.d_astBytes) / r.d_nodes, 'f', 1 ) : QString("-"), 6 )
+           .arg(r.d_symPool.d_allocated / 1024,8)
+           .arg( QString::number( double(r.d_peakMem) / 1024.0 / 1024.0, 'f', 1 ), 8 ) << endl;
+}
+
+static void writeJson( QTextStream& out, const Run& r, bool last )
+{
+    out << "  { \"definitions\": " << r.d_defs << ", \"lines\": " << r.d_lines <<
+           ", \"bytes\": " << r.d_bytes << ", \"issues\": " << r.d_issues <<
+           ", \"totalMs\": " << ms(r.d_total) << ", \"peakBytes\": " << r.d_peakMem <<
+           ", \"symPoolBytes\": " << r.d_symPool.d_allocated << ", \"symbols\": " << r.d_symPool.d_count <<
+           ", \"nodes\": " << r.d_nodes << ", \"astBytes\": " << r.d_astBytes << "," << endl <<
+           "    \"profile\": " << EbnfProfiler::toJson( r.d_profile, 4 ) << " }";
+    if( !last )
+        out << ",";
+    out << endl;
+}
+
+static bool runLessThan( const Run& lhs, const Run& rhs )
+{
+    return lhs.d_total < rhs.d_total;
+}
+
+static void printUsage( QTextStream& out )
+{
+    out << "usage: EbnfBench [options]" << endl <<
+           "  generates synthetic grammars of increasing size and runs lexer, parser, finishSyntax," << endl <<
+           "  FirstFollowSet, EbnfAnalyzer::checkForAmbiguity and CppGen on each of them" << endl <<
+           "  -sizes n,n,...  number of productions per grammar (default 100,200,400,800)" << endl <<
+           "  -fanout n       max. alternatives per production or group (default 4)" << endl <<
+           "  -depth n        max. nesting depth of groups (default 2)" << endl <<
+           "  -nullable p     percentage of optional or repeated factors (default 20)" << endl <<
+           "  -leftrec n      number of left recursion cycles (default 0)" << endl <<
+           "  -pred p         percentage of alternatives with \\LL:k\\ predicate (default 5)" << endl <<
+           "  -seed n         seed of the grammar generator (default 1)" << endl <<
+           "  -repeat n       run each size n times and report the fastest run (default 1)" << endl <<
+           "  -nogen          don't run CppGen" << endl <<
+           "  -out dir        directory for the CppGen output (default temp dir)" << endl <<
+           "  -dump dir       write the generated grammars to dir" << endl <<
+           "  -json           report as JSON on stdout" << endl <<
+           "  -profile        add the complete profile per size (text mode only)" << endl <<
+           "  -edit n         append a terminal to production Pn and report how many productions" << endl <<
+           "                  finishSyntax analyzes again (text mode only)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setOrganizationName("Rochus Keller");
+    a.setOrganizationDomain("github.com/rochus-keller/EbnfStudio");
+    a.setApplicationName("EbnfBench");
+    a.setApplicationVersion("0.9.12");
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    BenchGrammar::Params params;
+    QList<quint32> sizes;
+    quint32 repeat = 1;
+    bool gen = true;
+    bool json = false;
+    bool profile = false;
+    qint64 edit = -1;
+    QString outDir = QDir::temp().absoluteFilePath("EbnfBench");
+    QString dumpDir;
+    const QStringList args = a.arguments();
+    for( int i = 1; i < args.size(); i++ ) // arg 0 enthält Anwendungspfad
+    {
+        const QString& arg = args[ i ];
+        const bool hasVal = i + 1 < args.size();
+        bool ok = true;
+        if( arg == "-sizes" && hasVal )
+        {
+            foreach( const QString& s, args[++i].split(',') )
+            {
+                const quint32 n = s.toUInt(&ok);
+                if( !ok || n == 0 )
+                    break;
+                sizes << n;
+            }
+        }else if( arg == "-fanout" && hasVal )
+            params.d_fanOut = args[++i].toUInt(&ok);
+        else if( arg == "-depth" && hasVal )
+            params.d_depth = args[++i].toUInt(&ok);
+        else if( arg == "-nullable" && hasVal )
+            params.d_nullable = args[++i].toUInt(&ok);
+        else if( arg == "-leftrec" && hasVal )
+            params.d_leftRec = args[++i].toUInt(&ok);
+        else if( arg == "-pred" && hasVal )
+            params.d_predicates = args[++i].toUInt(&ok);
+        else if( arg == "-seed" && hasVal )
+            params.d_seed = args[++i].toUInt(&ok);
+        else if( arg == "-repeat" && hasVal )
+            repeat = qMax( args[++i].toUInt(&ok), 1u );
+        else if( arg == "-out" && hasVal )
+            outDir = args[++i];
+        else if( arg == "-dump" && hasVal )
+            dumpDir = args[++i];
+        else if( arg == "-nogen" )
+            gen = false;
+        else if( arg == "-json" )
+            json = true;
+        else if( arg == "-profile" )
+            profile = true;
+        else if( arg == "-edit" && hasVal )
+            edit = args[++i].toUInt(&ok);
+        else if( arg == "-h" || arg == "-help" || arg == "--help" )
+        {
+            printUsage(out);
+            return 0;
+        }else
+            ok = false;
+        if( !ok )
+        {
+            err << "invalid option " << arg << endl;
+            printUsage(err);
+            return 2;
+        }
+    }
+    if( sizes.isEmpty() )
+        sizes << 100 << 200 << 400 << 800;
+    std::sort( sizes.begin(), sizes.end() );
+
+    if( gen && !QDir().mkpath(outDir) )
+    {
+        err << "cannot create directory " << outDir << endl;
+        return 2;
+    }
+    if( !dumpDir.isEmpty() && !QDir().mkpath(dumpDir) )
+    {
+        err << "cannot create directory " << dumpDir << endl;
+        return 2;
+    }
+
+    if( json )
+        out << "[" << endl;
+    else
+        writeTextHeader(out);
+    for( int s = 0; s < sizes.size(); s++ )
+    {
+        params.d_productions = sizes[s];
+        BenchGrammar bg(params);
+        const QByteArray src = bg.generate();
+        if( !dumpDir.isEmpty() )
+        {
+            QFile f( QDir(dumpDir).absoluteFilePath( QString("bench_%1.ebnf").arg(sizes[s]) ) );
+            if( f.open(QIODevice::WriteOnly) )
+                f.write(src);
+        }
+        QList<Run> runs;
+        for( quint32 i = 0; i < repeat; i++ )
+            runs << runPipeline( src, outDir, gen );
+        const Run& r = *std::min_element( runs.begin(), runs.end(), runLessThan );
+        if( json )
+            writeJson( out, r, s + 1 == sizes.size() );
+        else
+        {
+            writeText( out, r );
+            if( profile )
+                out << endl << EbnfProfiler::toText( r.d_profile, 10 ) << endl;
+            if( edit >= 0 )
+                runEdit( out, src, edit );
+        }
+        out.flush();
+    }
+    if( json )
+        out << "]" << endl;
+    return 0;
+}
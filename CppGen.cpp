@@ -369,7 +369,7 @@ static inline bool containsNoPseudoKeyword( const Ast::NodeSet& ns )
 {
     foreach( const Ast::Node* n, ns)
     {
-        if( n->d_literal && GenUtils::looksLikeKeyword(n->d_tok.d_val.toStr()) )
+        if( n->isLiteral() && GenUtils::looksLikeKeyword(n->d_tok.d_val.toStr()) )
             return false;
     }
     return true;
@@ -386,7 +386,7 @@ void CppGen::writeCond( QTextStream& out, bool loop, const QList<const Ast::Node
         switch( n->d_type )
         {
         case Ast::Node::Terminal:
-            if( d_pseudoKeywords && n->d_literal && GenUtils::looksLikeKeyword(n->d_tok.d_val.toStr()) )
+            if( d_pseudoKeywords && n->isLiteral() && GenUtils::looksLikeKeyword(n->d_tok.d_val.toStr()) )
                 out << "la.d_code == Tok_" << GenUtils::symToString( n->d_tok.d_val.toStr() );
             else
                 out << "la.d_type == Tok_" << GenUtils::symToString( n->d_tok.d_val.toStr() );
@@ -454,7 +454,7 @@ void CppGen::writeNode(QTextStream& out, Ast::Node* node, int level)
     case Ast::Node::Terminal:
         out << ws(level) << ( d_genSynTree ? "if( ": "" )
             << "expect(Tok_" << GenUtils::symToString( node->d_tok.d_val.toStr() )
-            << ", " << ( node->d_literal && GenUtils::looksLikeKeyword(node->d_tok.d_val.toStr()) ? "true" : "false" )
+            << ", " << ( node->isLiteral() && GenUtils::looksLikeKeyword(node->d_tok.d_val.toStr()) ? "true" : "false" )
             << ", \"" << node->d_owner->d_tok.d_val.toBa() << "\")"
             << ( d_genSynTree ? " ) addTerminal(st)":"" )
             << ";" << endl;
@@ -681,7 +681,7 @@ void CppGen::handlePredicate(QTextStream& out, const Ast::Node* pred)
                 {
                     if( j != names.begin() )
                         out << "|| ";
-                    if( d_pseudoKeywords && j.value()->d_literal && GenUtils::looksLikeKeyword(j.value()->d_tok.d_val.toStr()) )
+                    if( d_pseudoKeywords && j.value()->isLiteral() && GenUtils::looksLikeKeyword(j.value()->d_tok.d_val.toStr()) )
                         out << "peek(" << i+1 << ").d_code == " << j.key() << " ";
                     else
                         out << "peek(" << i+1 << ").d_type == " << j.key() << " ";
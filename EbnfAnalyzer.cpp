@@ -20,7 +20,12 @@
 #include "EbnfAnalyzer.h"
 #include "EbnfErrors.h"
 #include "FirstFollowSet.h"
+#include "LlkDfa.h"
 #include <QtDebug>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QElapsedTimer>
+#include <algorithm>
 
 // https://stackoverflow.com/questions/19529560/left-recursive-grammar-identification
 
@@ -62,302 +67,22 @@ QSet<QString> EbnfAnalyzer::collectAllTerminalStrings(Ast::Node* node)
     return res;
 }
 
-static inline void resize( EbnfAnalyzer::LlkNodes& l, quint16 curBin )
+static EbnfAnalyzer::LlkNodes toLlkNodes( const FirstFollowSet::LlkSet& set, FirstFollowSet* tbl )
 {
-    if( l.size() <= curBin )
+    EbnfAnalyzer::LlkNodes res;
+    for( int i = 0; i < set.d_pos.size(); i++ )
     {
-        const int max = curBin + 1 - l.size();
-        for( int i = 0; i < max; i++ )
-            l.append( Ast::NodeRefSet() );
-    }
-}
-
-static inline int countNotEmpty( const EbnfAnalyzer::LlkNodes& l )
-{
-    int res = 0;
-    foreach( const Ast::NodeRefSet& s, l )
-        if( !s.isEmpty() )
-            res++;
-    return res;
-}
-
-static QByteArray ws( int level )
-{
-    QByteArray res;
-    for( int i = 0; i < qAbs(level); i++ )
-        res += " | ";
-    return res;
-}
-
-struct _SubNodeBin
-{
-    const Ast::Node* d_node;
-    quint16 d_from, d_to;
-    _SubNodeBin( const Ast::Node* n, int from, int to ):d_node(n),d_from(from),d_to(to){}
-};
-
-quint16 EbnfAnalyzer::calcLlkFirstSetImp(quint16 k, quint16 curBin, LlkNodes& res, const Ast::Node* node, FirstFollowSet* tbl, int level)
-{
-    // Gehe entlang der Blätter des Baums und sammle alle Terminals ein gruppiert in Distanzboxen.
-    // Wird eigentlich nur mit node=Sequence aufgerufen, da ja Predicates nur dort vorkommen
-
-    // returns maximum number of symbols covered by this node
-
-    if( node == 0 || node->doIgnore() )
-        return 0;
-
-//#ifdef _DEBUG
-#if 0
-    qDebug() << ws(level).constData() << "visit bin" << curBin << "l/c" <<
-                node->d_tok.d_lineNr << node->d_tok.d_colNr << node->toString()
-             << "level" << level << "k" << k << "reslen" << res.size(); // TEST
-#endif
-
-    if( level > k * 10 )
-    {
-#ifdef _DEBUG
-        qCritical() << ws(level).constData() << "calcLlkFirstSet level depth limit hit at " << level << k * 10;
-#endif
-        return 0;
-    }
-
-    switch( node->d_type )
-    {
-    case Ast::Node::Terminal:
-        resize( res, curBin );
-        res[curBin].insert( node ); // hier ist dieser node gemeint, nicht Follow(node)!
-//#ifdef _DEBUG
-#if 0
-        qDebug() << ws(level).constData() << "insert" << curBin <<
-                    node->d_tok.d_val.toBa() << node->d_tok.d_lineNr << node->d_tok.d_colNr; // TEST
-#endif
-        return 1;
-
-    case Ast::Node::Nonterminal:
-        if( node->d_def && node->d_def->d_node )
-            return calcLlkFirstSetImp( k, curBin, res, node->d_def->d_node, tbl,level+1 );
-        else
-        {
-            // wie Terinal
-            resize( res, curBin );
-            res[curBin].insert( node );
-//#ifdef _DEBUG
-#if 0
-            qDebug() << ws(level).constData() << "insert" << curBin <<
-                        node->d_tok.d_val.toBa() << node->d_tok.d_lineNr << node->d_tok.d_colNr; // TEST
-#endif
-            return 1;
-        }
-
-    case Ast::Node::Sequence:
-#if 0
-        foreach( Ast::Node* sub, node->d_subs )
-        {
-            if( sub->doIgnore() )
-                continue;
-            calcLlkFirstSet( k, curBin++, res, sub, tbl,level+1 );
-            if( res.size() >= k )
-                break;
-        }
-        // TODO: repetitions and options
-#else
-        {
-            QList<_SubNodeBin> toVisit;
-            int i = curBin;
-            int nullable = 0;
-            foreach( Ast::Node* sub, node->d_subs )
-            {
-                if( !sub->doIgnore() )
-                {
-                    toVisit << _SubNodeBin(sub,i-nullable,i);
-                    i++;
-                    if( sub->isNullable() )
-                        nullable++;
-                }
-            }
-            int max = 0;
-            for( int i = 0; i < toVisit.size(); i++ )
-            {
-                for( int bin = toVisit[i].d_from; bin <= toVisit[i].d_to && bin < k; bin++ )
-                {
-                    const quint16 tmp = calcLlkFirstSetImp( k, bin, res, toVisit[i].d_node, tbl, level+1 );
-                    if( tmp > 1 )
-                    {
-                        for( int j = i+1; j < toVisit.size(); j++ )
-                            toVisit[j].d_to += tmp - 1;
-                    }
-                    if( tmp > 0 && bin > max )
-                        max = bin;
-                }
-            }
-            return max - curBin + 1;
-        }
-        // TODO: repetition
-#endif
-        break;
-    case Ast::Node::Alternative:
-        {
-            quint16 count = 0;
-            foreach( Ast::Node* sub, node->d_subs )
-            {
-                if( sub->doIgnore() )
-                    continue;
-                const quint16 tmp = calcLlkFirstSetImp( k, curBin, res, sub, tbl,level+1 );
-                if( tmp > count )
-                    count = tmp;
-            }
-            return count;
-        }
-
-    default:
-        break;
-    }
-    return 0;
-}
-
-void EbnfAnalyzer::calcLlkFirstSet2Imp(quint16 k, int curBin, int level, LlkNodes& res,
-                                    const Ast::Node* node, FirstFollowSet* tbl, CheckSet& visited)
-{
-    if( node == 0 || node->doIgnore() )
-        return;
-    if( visited.contains(node) )
-        return;
-    else
-        visited.insert(node);
-
-//#ifdef _DEBUG
-#if 0
-    qDebug() << ws(level).constData() << "visit bin" << curBin << "l/c" <<
-                node->d_tok.d_lineNr << node->d_tok.d_colNr << node->toString()
-             << "level" << level << "k" << k << "res len" << res.size(); // TEST
-#endif
-
-    // TODO: ev. separate Funktion um von einem Node zum nächsten zu wandern und im Falle von usedBy und Alternative
-    // mehrere parallele Nodes zurückzugeben. Offen ist die Ermittlung des curBin.
-
-    if( level >= 0 )
-    {
-        // CheckSet visited; // don't check visited downwards
-        switch( node->d_type )
-        {
-        case Ast::Node::Terminal:
-            resize( res, curBin );
-            res[curBin].insert( node ); // hier ist dieser node gemeint, nicht Follow(node)!
-//#ifdef _DEBUG
-#if 0
-            qDebug() << ws(level).constData() << "insert" << curBin <<
-                        node->d_tok.d_val.data() << node->d_tok.d_lineNr << node->d_tok.d_colNr; // TEST
-#endif
-            break;
-        case Ast::Node::Nonterminal:
-            if( node->d_def && node->d_def->d_node )
-                calcLlkFirstSet2Imp( k, curBin, level + 1, res, node->d_def->d_node, tbl, visited );
-            else
-            {
-                // wie Terinal
-                resize( res, curBin );
-                res[curBin].insert( node );
-//#ifdef _DEBUG
-#if 0
-                qDebug() << ws(level).constData() << "insert" << curBin <<
-                            node->d_tok.d_val.data() << node->d_tok.d_lineNr << node->d_tok.d_colNr; // TEST
-#endif
-            }
+        const Ast::BitSet& pos = set.d_pos[i];
+        if( pos.isEmpty() )
             break;
-        case Ast::Node::Sequence:
-#if 1
-            foreach( Ast::Node* sub, node->d_subs )
-            {
-                if( sub->doIgnore() )
-                    continue;
-                calcLlkFirstSet2Imp( k, curBin++, level + 1, res, sub, tbl, visited );
-                if( res.size() >= k )
-                    break;
-            }
-            // TODO: repetition, option
-#else
-#if 1       // TODO the following does not work yet
-            {
-                QList<const Ast::Node*> toVisit;
-                foreach( Ast::Node* sub, node->d_subs )
-                {
-                    if( !sub->doIgnore() )
-                        toVisit << sub;
-                }
-                for( int i = curBin; i < k && i < toVisit.size(); i++ )
-                {
-                    for( int j = i; j < toVisit.size(); j++ )
-                    {
-                        visited.clear();
-                        calcLlkFirstSet2Imp( k, i, level + 1, res, toVisit[j], tbl, visited ); // TODO: visited too strong
-                        if( !toVisit[j]->isNullable() )
-                            break;
-                    }
-                    if( res.size() >= k )
-                        break;
-                }
-            }
-            // TODO: repetition
-#else
-            for( int i = curBin; i < k; i++ )
-            {
-                QSet<const Ast::Node*> check = visited;
-                int j = 0;
-                foreach( Ast::Node* sub, node->d_subs )
-                {
-                    if( sub->doIgnore() )
-                        continue;
-                    if( j++ < i )
-                        continue;
-                    calcLlkFirstSet2Imp( k, i, level + 1, res, sub, tbl, check );
-                    if( !sub->isNullable() )
-                        break;
-                }
-                //if( res.size() >= k )
-                //    break;
-            }
-            // TODO: repetition
-#endif
-#endif
-            break;
-        case Ast::Node::Alternative:
-            foreach( Ast::Node* sub, node->d_subs )
-            {
-                if( sub->doIgnore() )
-                    continue;
-                calcLlkFirstSet2Imp( k, curBin, level + 1, res, sub, tbl, visited );
-            }
-            // TODO: repetition
-            break;
-        default:
-            break;
-        }
-    }
-    // Vermutlich unnötig, auch nach oben zu suchen
-    if( level <= 0 && res.size() < k )
-    {
-        // Vorsicht, es kann sein dass wir beim Weg nach oben wieder dort vorbeikommen, wo man angefangen haben
-        curBin = res.size() - 1;
-        if( const Ast::Node* next = node->getNext(&curBin) )
+        res.append( Ast::NodeRefSet() );
+        for( quint32 id = pos.nextBit(0); id != Ast::BitSet::Invalid; id = pos.nextBit(id + 1) )
         {
-            // finde nächsten nach node
-            calcLlkFirstSet2Imp(k,curBin,0,res,next,tbl, visited);
-            if( res.size() >= k )
-                return;
-        }else
-        {
-            // gehe entlang node->d_owner->d_usedBy
-            foreach( const Ast::Node* use, node->d_owner->d_usedBy )
-            {
-                int index = curBin;
-                const Ast::Node* next = use->getNext(&index);
-                if( next )
-                    calcLlkFirstSet2Imp( k, index, 0, res, next, tbl, visited );
-                else // obsolet wegen visited: if( level > -10 ) // begrenze die Tiefe, da es hier ab und zu unendlich weitergeht TODO
-                    calcLlkFirstSet2Imp( k,index,level - 1 , res, use, tbl, visited );
-            }
+            if( const Ast::Node* n = tbl->getLlkSymbol( id ) )
+                res.last().insert( n );
         }
     }
+    return res;
 }
 
 bool EbnfAnalyzer::findPath(Ast::ConstNodeList& path, const Ast::Node* to)
@@ -469,7 +194,7 @@ Ast::NodeRefSet EbnfAnalyzer::intersectAll(const EbnfAnalyzer::LlkNodes& lhs, co
 
 void EbnfAnalyzer::calcLlkFirstSet(quint16 k, EbnfAnalyzer::LlkNodes& res, const Ast::Node* node, FirstFollowSet* tbl)
 {
-    calcLlkFirstSetImp( k, 0, res, node, tbl, 0 );
+    res = toLlkNodes( tbl->getLlkFirstSet( node, k ), tbl );
 }
 
 void EbnfAnalyzer::calcLlkFirstTree(quint16 k, Ast::NodeTree* nt, const Ast::Node* node, FirstFollowSet* tbl)
@@ -516,27 +241,94 @@ void EbnfAnalyzer::calcLlkFirstTree(quint16 k, Ast::NodeTree* nt, const Ast::Nod
 
 void EbnfAnalyzer::calcLlkFirstSet2(quint16 k, EbnfAnalyzer::LlkNodes& res, const Ast::Node* node, FirstFollowSet* tbl)
 {
-    QSet<const Ast::Node*> visited;
-    calcLlkFirstSet2Imp( k, 0, 0,res, node, tbl, visited );
+    res = toLlkNodes( tbl->getLlkEntrySet( node, k ), tbl );
+}
+
+// checks one definition in a worker thread; the issues are collected in a buffer and only reported when all
+// definitions are done, so the result is the same as if the definitions were checked one after the other
+class AmbiguityCheck : public QRunnable
+{
+public:
+    AmbiguityCheck( const Ast::Definition* d, FirstFollowSet* set ):d_def(d),d_set(set),d_nsecs(0)
+    {
+        setAutoDelete(false);
+        d_errs.setBuffered(true);
+    }
+    void run()
+    {
+        QElapsedTimer timer;
+        timer.start();
+        try
+        {
+            EbnfAnalyzer::checkForAmbiguity( d_def->d_node, d_set, &d_errs );
+        }catch(...)
+        {
+            qCritical() << "EbnfAnalyzer::checkForAmbiguity exception";
+        }
+        d_nsecs = timer.nsecsElapsed();
+    }
+    const Ast::Definition* d_def;
+    FirstFollowSet* d_set;
+    EbnfErrors d_errs;
+    qint64 d_nsecs;
+};
+
+static void prepareSets( const Ast::Node* node, FirstFollowSet* set, QList<quint16>& ks )
+{
+    // asks for the sets the checks of the node will ask for, so they are in the caches of the frozen set
+    if( node == 0 )
+        return;
+    if( node->d_type == Ast::Node::Predicate )
+    {
+        const int ll = node->getLlk();
+        if( ll > 0 && !ks.contains(ll) )
+            ks.append(ll);
+        return;
+    }
+    if( node->doIgnore() )
+        return;
+    set->getFirstSet(node);
+    if( node->d_type == Ast::Node::Sequence )
+        set->getFollowSet(node);
+    foreach( const Ast::Node* sub, node->d_subs )
+        prepareSets( sub, set, ks );
 }
 
 void EbnfAnalyzer::checkForAmbiguity(FirstFollowSet* set, EbnfErrors* err)
 {
+    EbnfProfiler::Scope prof("checkForAmbiguity");
     EbnfSyntax* syn = set->getSyntax();
+    QList<const Ast::Definition*> defs;
+    QList<quint16> ks;
+    ks << 1; // see LlkDfa
     for( int i = 0; i < syn->getOrderedDefs().size(); i++ )
     {
         const Ast::Definition* d = syn->getOrderedDefs()[i];
         if( d->doIgnore() || ( i != 0 && d->d_usedBy.isEmpty() ) || d->d_node == 0 )
             continue;
+        defs.append(d);
+        prepareSets( d->d_node, set, ks );
+    }
+    // the workers only read the syntax and the frozen set, so they don't have to wait for each other
+    const bool frozen = set->isFrozen();
+    set->freeze( ks );
+    QList<AmbiguityCheck*> checks;
+    QThreadPool pool;
+    foreach( const Ast::Definition* d, defs )
+    {
+        checks.append( new AmbiguityCheck( d, set ) );
+        pool.start( checks.last() );
+    }
+    pool.waitForDone();
+    if( !frozen )
+        set->thaw();
 
-        try
-        {
-            checkForAmbiguity( d->d_node, set, err );
-        }catch(...)
-        {
-            qCritical() << "EbnfAnalyzer::checkForAmbiguity exception";
-        }
+    foreach( AmbiguityCheck* c, checks )
+    {
+        err->replay( c->d_errs.getBuffer() );
+        EbnfProfiler::addTime( "checkForAmbiguity", c->d_nsecs, c->d_def->d_tok.d_val.toBa() );
     }
+    qDeleteAll( checks );
 }
 
 void EbnfAnalyzer::checkForAmbiguity(Ast::Node* node, FirstFollowSet* set, EbnfErrors* errs , bool recursive)
@@ -580,69 +372,102 @@ void EbnfAnalyzer::findAmbiguousAlternatives(Ast::Node* node, FirstFollowSet* se
     if( node->d_type != Ast::Node::Alternative )
         return;
 
-    // Check each pair of alternatives
+    // Instead of intersecting the FIRST sets of each pair of alternatives, index the alternatives by the
+    // symbols of their FIRST sets; only the pairs sharing a symbol are candidates
+    EbnfSyntax* syn = set->getSyntax();
+    QVector<Ast::NodeRefSet> first( node->d_subs.size() );
+    QVector<quint64> index; // symbol id, alternative
     for(int i = 0; i < node->d_subs.size(); i++)
     {
-        for(int j = i + 1; j < node->d_subs.size(); j++)
-        {
-            const Ast::Node* a = node->d_subs[i];
-            const Ast::Node* b = node->d_subs[j];
-            if( a->doIgnore() || b->doIgnore() )
-                continue;
-            // TODO: wenn eine Alternative Nullable ist, müsste auch noch ihre Follow mitberücksichtigt werden!
-            const Ast::NodeRefSet diff = set->getFirstSet(a) & set->getFirstSet(b);
-            if( diff.isEmpty() )
-                continue;
+        if( node->d_subs[i]->doIgnore() )
+            continue;
+        first[i] = set->getFirstSet(node->d_subs[i]);
+        foreach( const Ast::NodeRef& r, first[i] )
+            index.append( quint64( syn->getSymId( r.d_node ) ) << 32 | i );
+    }
+    std::sort( index.begin(), index.end() );
+    QVector<quint64> pairs;
+    for( int x = 0; x < index.size(); x++ )
+    {
+        for( int y = x + 1; y < index.size() && ( index[y] >> 32 ) == ( index[x] >> 32 ); y++ )
+            pairs.append( ( index[x] & 0xffffffff ) << 32 | ( index[y] & 0xffffffff ) );
+    }
+    std::sort( pairs.begin(), pairs.end() );
+    pairs.erase( std::unique( pairs.begin(), pairs.end() ), pairs.end() );
 
-            const Ast::Node* predA = EbnfSyntax::firstPredicateOf(a);
-            const Ast::Node* predB = EbnfSyntax::firstPredicateOf(b);
-            int ll = 0;
-            if( predA != 0 )
-                ll = predA->getLlk();
-            if( predB != 0 )
-                ll = qMax( ll, predB->getLlk() );
-
-            // TODO: each alternative might have a different predicate type LL or LA
-            // currently just assume everything is ok if an LA predicate is present
-            if( (predA && !predA->getLa().isEmpty()) || (predB && !predB->getLa().isEmpty()) )
-                continue;
+    foreach( quint64 pair, pairs )
+    {
+        const int i = pair >> 32;
+        const int j = pair & 0xffffffff;
+        const Ast::Node* a = node->d_subs[i];
+        const Ast::Node* b = node->d_subs[j];
+        // TODO: wenn eine Alternative Nullable ist, müsste auch noch ihre Follow mitberücksichtigt werden!
+        const Ast::NodeRefSet diff = first[i] & first[j];
+        if( diff.isEmpty() )
+            continue;
 
-            if( ll > 0 )
-            {
-                EbnfAnalyzer::LlkNodes llkA;
-                calcLlkFirstSet2( ll,  llkA, a, set );
-                EbnfAnalyzer::LlkNodes llkB;
-                calcLlkFirstSet2( ll, llkB, b, set );
+        const Ast::Node* predA = EbnfSyntax::firstPredicateOf(a);
+        const Ast::Node* predB = EbnfSyntax::firstPredicateOf(b);
+        int ll = 0;
+        if( predA != 0 )
+            ll = predA->getLlk();
+        if( predB != 0 )
+            ll = qMax( ll, predB->getLlk() );
+
+        // TODO: each alternative might have a different predicate type LL or LA
+        // currently just assume everything is ok if an LA predicate is present
+        if( (predA && !predA->getLa().isEmpty()) || (predB && !predB->getLa().isEmpty()) )
+            continue;
 
-                const Ast::NodeRefSet diff = intersectAll( llkA, llkB );
-                if( llkA.size() == llkB.size() && llkA.size() == ll && diff.isEmpty() )
-                    continue;
+        if( ll > 0 )
+        {
+            // the predicate is effective if no sequence of up to ll symbols can start both alternatives; the
+            // symbols by position are a cheap test, the lookahead DFA is exact
+            if( !set->getLlkEntrySet( a, ll ).intersects( set->getLlkEntrySet( b, ll ) ) )
+                continue;
+            if( !isAmbiguous( node, i, j, ll, set ) )
+                continue;
 
-                const Ast::Node* pred = predA != 0 ? predA : predB;
-                const Ast::Node* other = predA != 0 ? b : a;
-                if( pred )
-                    errs->warning(EbnfErrors::Analysis, pred->d_tok.d_lineNr, pred->d_tok.d_colNr,
-                            QString("predicate not effective for LL(%1)").arg(ll),
-                                  QVariant::fromValue(EbnfSyntax::IssueData(EbnfSyntax::IssueData::BadPred,
-                                                                            pred,other)));
+            const Ast::Node* pred = predA != 0 ? predA : predB;
+            const Ast::Node* other = predA != 0 ? b : a;
+            if( pred )
+                errs->warning(EbnfErrors::Analysis, pred->d_tok.d_lineNr, pred->d_tok.d_colNr,
+                        QString("predicate not effective for LL(%1)").arg(ll),
+                              QVariant::fromValue(EbnfSyntax::IssueData(EbnfSyntax::IssueData::BadPred,
+                                                                        pred,other)));
 
-            }
+        }
 
-            if( !diff.isEmpty() )
-            {
-                const Ast::Node* aa = EbnfSyntax::firstVisibleElementOf(a);
-                Ast::NodeSet diff2 = EbnfSyntax::collectNodes( diff, set->getFirstNodeSet(a) );
-                diff2 += EbnfSyntax::collectNodes( diff, set->getFirstNodeSet(b) );
-                errs->error(EbnfErrors::Analysis, aa->d_tok.d_lineNr, aa->d_tok.d_colNr,
-                            QString("alternatives %1 and %2 are LL(1) ambiguous because of %3")
-                            .arg(i+1).arg(j+1).arg(EbnfSyntax::pretty(diff)),
-                            QVariant::fromValue(EbnfSyntax::IssueData(
-                                                    EbnfSyntax::IssueData::AmbigAlt,a,b,diff2.toList())));
-            }
+        if( !diff.isEmpty() )
+        {
+            const Ast::Node* aa = EbnfSyntax::firstVisibleElementOf(a);
+            Ast::NodeSet diff2 = EbnfSyntax::collectNodes( diff, set->getFirstNodeSet(a) );
+            diff2 += EbnfSyntax::collectNodes( diff, set->getFirstNodeSet(b) );
+            errs->error(EbnfErrors::Analysis, aa->d_tok.d_lineNr, aa->d_tok.d_colNr,
+                        QString("alternatives %1 and %2 are LL(1) ambiguous because of %3")
+                        .arg(i+1).arg(j+1).arg(EbnfSyntax::pretty(diff)),
+                        QVariant::fromValue(EbnfSyntax::IssueData(
+                                                EbnfSyntax::IssueData::AmbigAlt,a,b,diff2.toList())));
         }
     }
 }
 
+bool EbnfAnalyzer::isAmbiguous(const Ast::Node* node, int a, int b, int ll, FirstFollowSet* set)
+{
+    QByteArray detail;
+    if( EbnfProfiler::isEnabled() )
+        detail = node->d_owner->d_tok.d_val.toBa() + " " + QByteArray::number(node->d_tok.d_lineNr) + ":" +
+                QByteArray::number(node->d_tok.d_colNr);
+    EbnfProfiler::Scope prof("buildLlkDfa", detail);
+    LlkDfa dfa( set, ll );
+    if( a < 0 )
+        dfa.build( node );
+    else
+        dfa.build( node, a, b );
+    EbnfProfiler::addIterations( "buildLlkDfa", dfa.getStateCount(), detail );
+    return dfa.isAmbiguous();
+}
+
 void EbnfAnalyzer::findAmbiguousOptionals(Ast::Node* seq, FirstFollowSet* set, EbnfErrors* errs)
 {
     // ZeroOrOne and ZeroOrMore haben genau dieselben Mehrdeutigkeitskriterien. Es ist egal, ob
@@ -694,19 +519,10 @@ void EbnfAnalyzer::findAmbiguousOptionals(Ast::Node* seq, FirstFollowSet* set, E
             ll = pred->getLlk();
             if( ll > 0 )
             {
-                EbnfAnalyzer::LlkNodes llkA;
-                calcLlkFirstSet2( ll,  llkA, a, set );
-
-                EbnfAnalyzer::LlkNodes llkB;
-                if( b == 0 )
-                {
-                    QSet<const Ast::Node*> visited;
-                    calcLlkFirstSet2Imp(ll,0,-1,llkB, seq, set, visited );
-                }else
-                    calcLlkFirstSet2( ll, llkB, b, set );
-
-                const Ast::NodeRefSet diff = intersectAll( llkA, llkB );
-                if( llkA.size() == llkB.size() && llkA.size() == ll && diff.isEmpty() )
+                // the predicate is effective if no sequence of up to ll symbols can both enter and skip a
+                if( !set->getLlkEntrySet( a, ll ).intersects( set->getLlkFollowSet( a, ll ) ) )
+                    continue;
+                if( !isAmbiguous( a, -1, -1, ll, set ) )
                     continue;
                 errs->warning(EbnfErrors::Analysis, pred->d_tok.d_lineNr, pred->d_tok.d_colNr,
                             QString("predicate not effective for LL(%1)").arg(ll),
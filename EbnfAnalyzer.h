@@ -36,7 +36,8 @@ public:
     typedef QList<Ast::NodeRefSet> LlkNodes;
     static Ast::NodeRefSet intersectAll( const LlkNodes& lhs, const LlkNodes& rhs );
 
-    // NOTE: this is only an approximation
+    // the symbols by position of FirstFollowSet::getLlkFirstSet (the node alone) and getLlkEntrySet (including
+    // the follow); a position only approximates the sequences
     static void calcLlkFirstSet(quint16 k, LlkNodes&, const Ast::Node* node, FirstFollowSet* );
     static void calcLlkFirstSet2(quint16 k, LlkNodes&, const Ast::Node* node, FirstFollowSet* );
 
@@ -50,12 +51,10 @@ protected:
     static QSet<QString> collectAllTerminalStrings( Ast::Node* );
     static void findAmbiguousAlternatives( Ast::Node*, FirstFollowSet*, EbnfErrors* );
     static void findAmbiguousOptionals( Ast::Node*, FirstFollowSet*, EbnfErrors* );
+    // decides a predicate by the lookahead DFA of the subs a and b of an Alternative or, if a < 0, of entering
+    // or skipping the node
+    static bool isAmbiguous( const Ast::Node*, int a, int b, int ll, FirstFollowSet* );
     static void reportAmbig(Ast::Node* seq, int ambigIdx, const Ast::NodeRefSet& diff, const Ast::NodeSet& ambigSet2, FirstFollowSet*, EbnfErrors* );
-    typedef QSet<const Ast::Node*> CheckSet;
-    static void calcLlkFirstSet2Imp(quint16 k, int curBin, int level, LlkNodes&, const Ast::Node* node,
-                                    FirstFollowSet*, CheckSet& visited );
-    static quint16 calcLlkFirstSetImp(quint16 k, quint16 curBin, LlkNodes&,
-                                const Ast::Node* node, FirstFollowSet*, int level );
     static bool findPath( Ast::ConstNodeList& path, const Ast::Node* to );
 };
 
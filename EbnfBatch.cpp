@@ -0,0 +1,282 @@
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "EbnfBatch.h"
+#include "EbnfLexer.h"
+#include "EbnfParser.h"
+#include "EbnfSyntax.h"
+#include "EbnfAnalyzer.h"
+#include "FirstFollowSet.h"
+#include "GenUtils.h"
+#include "CppGen.h"
+#include "CocoGen.h"
+#include "AntlrGen.h"
+#include "LlgenGen.h"
+#include "SynTreeGen.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QTextStream>
+#include <algorithm>
+
+// the errors come from a QSet in random order; all compared fields make the order of the report stable
+static bool issueLessThan( const EbnfErrors::Entry& lhs, const EbnfErrors::Entry& rhs )
+{
+    if( lhs.d_line != rhs.d_line )
+        return lhs.d_line < rhs.d_line;
+    if( lhs.d_col != rhs.d_col )
+        return lhs.d_col < rhs.d_col;
+    if( lhs.d_isErr != rhs.d_isErr )
+        return lhs.d_isErr; // errors first
+    if( lhs.d_source != rhs.d_source )
+        return lhs.d_source < rhs.d_source;
+    return lhs.d_msg < rhs.d_msg;
+}
+
+EbnfBatch::EbnfBatch():d_gens(NoGen),d_ambig(false),d_profile(false)
+{
+}
+
+EbnfBatch::Result EbnfBatch::process(const QString& path)
+{
+    Result res;
+    res.d_path = path;
+
+    QFile in(path);
+    if( !in.open(QIODevice::ReadOnly) )
+    {
+        res.d_ioError = true;
+        return res;
+    }
+
+    EbnfToken::resetSymTbl();
+    if( d_profile )
+    {
+        EbnfProfiler::reset();
+        EbnfProfiler::setEnabled(true);
+    }
+
+    EbnfErrors errs;
+    EbnfLexer lex;
+    QFileInfo info(path);
+    lex.readKeywordsFromFile( info.absoluteDir().absoluteFilePath( info.completeBaseName() + ".keywords" ) );
+    lex.setStream( &in );
+
+    EbnfParser p;
+    p.setErrors(&errs);
+    EbnfSyntaxRef syn;
+    FirstFollowSet tbl;
+    if( p.parse( &lex ) )
+    {
+        syn = p.getSyntax();
+        const bool ok = syn->finishSyntax();
+        if( ok && ( d_ambig || d_gens != NoGen ) )
+        {
+            tbl.setSyntax( syn.data() );
+            if( d_ambig )
+                EbnfAnalyzer::checkForAmbiguity( &tbl, &errs );
+        }
+    }
+
+    // errs.getErrCount() is reset by the individual phases, so count the entries instead
+    EbnfErrors::EntryList::const_iterator i;
+    for( i = errs.getErrors().begin(); i != errs.getErrors().end(); ++i )
+    {
+        res.d_issues.append( *i );
+        if( (*i).d_isErr )
+            res.d_errCount++;
+        else
+            res.d_warnCount++;
+    }
+    std::stable_sort( res.d_issues.begin(), res.d_issues.end(), issueLessThan );
+
+    if( syn.constData() && res.d_errCount == 0 && d_gens != NoGen )
+    {
+        EbnfProfiler::Scope prof("generate");
+        res.d_generated = generate( path, syn.data(), &tbl );
+    }
+    if( d_profile )
+    {
+        res.d_profile = EbnfProfiler::getEntries();
+        res.d_symPool = EbnfToken::getSymPoolStats();
+        res.d_setCache = tbl.getCacheStats();
+        EbnfProfiler::setEnabled(false);
+    }
+    return res;
+}
+
+bool EbnfBatch::generate(const QString& path, EbnfSyntax* syn, FirstFollowSet* tbl)
+{
+    // same sequence as the corresponding MainWindow::onGen* commands
+    GenUtils::loadTokMap( path );
+    QFileInfo info(path);
+    const QString base = info.absoluteDir().absoluteFilePath( info.completeBaseName() );
+    bool ok = true;
+    if( d_gens & GenCpp )
+    {
+        CppGen gen;
+        ok = gen.generate( base + ".atg", syn, tbl ) && ok;
+    }
+    if( d_gens & GenVisitor )
+    {
+        CppGen gen;
+        ok = gen.writeVisitor( info.absoluteDir().absoluteFilePath( "Visitor.cpp" ), syn, tbl ) && ok;
+    }
+    if( d_gens & GenCoco )
+    {
+        CocoGen gen;
+        ok = gen.generate( base + ".atg", syn, tbl, true ) && ok;
+    }
+    if( d_gens & GenAntlr )
+        ok = AntlrGen::generate( base + ".g", syn ) && ok;
+    if( d_gens & GenLlgen )
+        ok = LlgenGen::generate( base + ".g", syn, tbl ) && ok;
+    if( d_gens & ( GenCpp | GenCoco ) )
+    {
+        ok = SynTreeGen::generateTt( path, syn, true, false ) && ok;
+        ok = SynTreeGen::generateTree( path, syn, true ) && ok;
+    }else
+    {
+        if( d_gens & GenSynTree )
+            ok = SynTreeGen::generateTree( path, syn ) && ok;
+        if( d_gens & GenTt )
+            ok = SynTreeGen::generateTt( path, syn, true, true ) && ok;
+    }
+    return ok;
+}
+
+void EbnfBatch::writeText(QTextStream& out, const Result& res)
+{
+    if( res.d_ioError )
+    {
+        out << res.d_path << ": error: cannot open file for reading" << endl;
+        return;
+    }
+    for( int i = 0; i < res.d_issues.size(); i++ )
+    {
+        const EbnfErrors::Entry& e = res.d_issues[i];
+        out << res.d_path << ":" << e.d_line << ":" << e.d_col << ": " <<
+               ( e.d_isErr ? "error: " : "warning: " ) << e.d_msg << endl;
+    }
+    if( !res.d_profile.isEmpty() )
+    {
+        out << res.d_path << ": profile:" << endl << EbnfProfiler::toText( res.d_profile );
+        const EbnfToken::SymPoolStats& p = res.d_symPool;
+        out << res.d_path << ": symbol pool: " << p.d_count << " symbols (" << p.d_pinned << " pinned), " <<
+               p.d_used / 1024 << " KB used of " << p.d_allocated / 1024 << " KB in " << p.d_chunks <<
+               " chunks, " << p.d_reclaimed << " reclaimed, generation " << p.d_generation << endl;
+        const FirstFollowSet::CacheStats& c = res.d_setCache;
+        out << res.d_path << ": set cache:";
+        for( int i = 0; i < FirstFollowSet::CacheStats::MaxKind; i++ )
+        {
+            const quint32 total = c.d_hits[i] + c.d_misses[i];
+            out << ( i == 0 ? " " : ", " ) << FirstFollowSet::CacheStats::s_kindName[i] << " " << c.d_hits[i] <<
+                   "/" << total << " hits";
+            if( total )
+                out << " (" << c.d_hits[i] * 100 / total << "%)";
+        }
+        out << endl;
+    }
+}
+
+static QString jsonString( const QString& str )
+{
+    QString res;
+    res.reserve( str.size() + 2 );
+    res += QChar('"');
+    for( int i = 0; i < str.size(); i++ )
+    {
+        const QChar ch = str[i];
+        switch( ch.unicode() )
+        {
+        case '"':
+            res += "\\\"";
+            break;
+        case '\\':
+            res += "\\\\";
+            break;
+        case '\n':
+            res += "\\n";
+            break;
+        case '\r':
+            res += "\\r";
+            break;
+        case '\t':
+            res += "\\t";
+            break;
+        default:
+            if( ch.unicode() < 0x20 )
+                res += QString("\\u%1").arg( ch.unicode(), 4, 16, QChar('0') );
+            else
+                res += ch;
+            break;
+        }
+    }
+    res += QChar('"');
+    return res;
+}
+
+static const char* s_sourceName[] = { "syntax", "semantics", "analysis" };
+
+void EbnfBatch::writeJson(QTextStream& out, const QList<Result>& results)
+{
+    out << "[" << endl;
+    for( int r = 0; r < results.size(); r++ )
+    {
+        const Result& res = results[r];
+        out << "  { \"file\": " << jsonString( res.d_path ) <<
+               ", \"ioError\": " << ( res.d_ioError ? "true" : "false" ) <<
+               ", \"errors\": " << res.d_errCount <<
+               ", \"warnings\": " << res.d_warnCount <<
+               ", \"generated\": " << ( res.d_generated ? "true" : "false" );
+        if( !res.d_profile.isEmpty() )
+        {
+            const EbnfToken::SymPoolStats& p = res.d_symPool;
+            out << "," << endl << "    \"profile\": " << EbnfProfiler::toJson( res.d_profile, 4 );
+            out << "," << endl << "    \"symPool\": { \"symbols\": " << p.d_count << ", \"pinned\": " << p.d_pinned <<
+                   ", \"usedBytes\": " << p.d_used << ", \"allocatedBytes\": " << p.d_allocated <<
+                   ", \"chunks\": " << p.d_chunks << ", \"reclaimed\": " << p.d_reclaimed <<
+                   ", \"generation\": " << p.d_generation << " }";
+            const FirstFollowSet::CacheStats& c = res.d_setCache;
+            out << "," << endl << "    \"setCache\": {";
+            for( int i = 0; i < FirstFollowSet::CacheStats::MaxKind; i++ )
+                out << ( i == 0 ? " " : ", " ) << "\"" << FirstFollowSet::CacheStats::s_kindName[i] <<
+                       "\": { \"hits\": " << c.d_hits[i] << ", \"misses\": " << c.d_misses[i] << " }";
+            out << " }";
+        }
+        out << ", \"issues\": [";
+        for( int i = 0; i < res.d_issues.size(); i++ )
+        {
+            const EbnfErrors::Entry& e = res.d_issues[i];
+            if( i != 0 )
+                out << ",";
+            out << endl << "    { \"line\": " << e.d_line << ", \"col\": " << e.d_col <<
+                   ", \"severity\": \"" << ( e.d_isErr ? "error" : "warning" ) << "\"" <<
+                   ", \"source\": \"" << ( e.d_source <= EbnfErrors::Analysis ? s_sourceName[e.d_source] : "" ) << "\"" <<
+                   ", \"message\": " << jsonString( e.d_msg ) << " }";
+        }
+        if( !res.d_issues.isEmpty() )
+            out << endl << "  ";
+        out << "] }";
+        if( r + 1 < results.size() )
+            out << ",";
+        out << endl;
+    }
+    out << "]" << endl;
+}
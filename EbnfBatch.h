@@ -0,0 +1,74 @@
+#ifndef EBNFBATCH_H
+#define EBNFBATCH_H
+
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QStringList>
+#include "EbnfErrors.h"
+#include "EbnfProfiler.h"
+#include "EbnfToken.h"
+#include "FirstFollowSet.h"
+
+class QTextStream;
+class EbnfSyntax;
+
+// Runs the complete pipeline (keywords, lexer, parser, finishSyntax, FirstFollowSet, EbnfAnalyzer and
+// the generators) on a file without any widget; used by the EbnfBatch command line tool
+class EbnfBatch
+{
+public:
+    enum Generator { NoGen = 0, GenCpp = 0x01, GenVisitor = 0x02, GenCoco = 0x04, GenAntlr = 0x08,
+                     GenLlgen = 0x10, GenSynTree = 0x20, GenTt = 0x40 };
+
+    typedef QList<EbnfErrors::Entry> Issues;
+    struct Result
+    {
+        QString d_path;
+        Issues d_issues; // sorted by line and column
+        EbnfProfiler::Entries d_profile; // only if setProfile(true)
+        EbnfToken::SymPoolStats d_symPool; // only if setProfile(true), sampled while the syntax is alive
+        FirstFollowSet::CacheStats d_setCache; // only if setProfile(true)
+        quint32 d_errCount;
+        quint32 d_warnCount;
+        bool d_ioError;
+        bool d_generated;
+        Result():d_errCount(0),d_warnCount(0),d_ioError(false),d_generated(false){}
+        bool hasErrors() const { return d_ioError || d_errCount > 0; }
+    };
+
+    EbnfBatch();
+
+    void setCheckAmbiguity( bool on ) { d_ambig = on; }
+    void setGenerators( int g ) { d_gens = g; }
+    void setProfile( bool on ) { d_profile = on; }
+
+    Result process( const QString& path );
+
+    static void writeText( QTextStream&, const Result& );
+    static void writeJson( QTextStream&, const QList<Result>& );
+protected:
+    bool generate( const QString& path, EbnfSyntax*, FirstFollowSet* );
+private:
+    int d_gens;
+    bool d_ambig;
+    bool d_profile;
+};
+
+#endif // EBNFBATCH_H
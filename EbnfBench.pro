@@ -0,0 +1,71 @@
+#/*
+#* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+#*
+#* This file is part of the EbnfStudio application.
+#*
+#* The following is the license that applies to this copy of the
+#* application. For a license to use the application under conditions
+#* other than those described here, please email to me@rochus-keller.ch.
+#*
+#* GNU General Public License Usage
+#* This file may be used under the terms of the GNU General Public
+#* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+#* Foundation and appearing in the file LICENSE.GPL included in
+#* the packaging of this file. Please review the following information
+#* to ensure GNU General Public Licensing requirements will be met:
+#* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+#* http://www.gnu.org/copyleft/gpl.html.
+#*/
+
+QT       += core
+QT       -= gui
+
+TARGET = EbnfBench
+TEMPLATE = app
+CONFIG   += console
+CONFIG   -= app_bundle
+
+CONFIG(debug, debug|release) {
+        DEFINES += _DEBUG
+}
+
+QMAKE_CXXFLAGS += -Wno-reorder -Wno-unused-parameter -Wno-unused-function -Wno-unused-variable
+
+win32 {
+        LIBS += -lpsapi
+}
+
+SOURCES += BenchMain.cpp \
+    BenchGrammar.cpp \
+    EbnfLexer.cpp \
+    EbnfToken.cpp \
+    EbnfSyntax.cpp \
+    EbnfParser.cpp \
+    EbnfErrors.cpp \
+    EbnfAnalyzer.cpp \
+    GenUtils.cpp \
+    FirstFollowSet.cpp \
+    FlatSyntax.cpp \
+    LlkDfa.cpp \
+    SyntaxDelta.cpp \
+    LaParser.cpp \
+    CppGen.cpp \
+    EbnfProfiler.cpp
+
+HEADERS  += BenchGrammar.h \
+    EbnfLexer.h \
+    EbnfToken.h \
+    EbnfSyntax.h \
+    EbnfParser.h \
+    EbnfErrors.h \
+    EbnfAnalyzer.h \
+    GenUtils.h \
+    FirstFollowSet.h \
+    FlatSyntax.h \
+    LlkDfa.h \
+    SyntaxDelta.h \
+    LaParser.h \
+    CppGen.h \
+    EbnfProfiler.h
+
+INCLUDEPATH += ..
@@ -21,7 +21,7 @@
 #include "EbnfErrors.h"
 #include "EbnfHighlighter.h"
 #include "EbnfLexer.h"
-#include "EbnfParser.h"
+#include "EbnfParseJob.h"
 #include <GuiTools/AutoMenu.h>
 #include <QPainter>
 #include <QtDebug>
@@ -40,14 +40,20 @@
 #include <QMessageBox>
 
 EbnfEditor::EbnfEditor(QWidget *parent) :
-    CodeEditor(parent)
+    CodeEditor(parent),d_job(0),d_pending(false)
 {
     d_errs = new EbnfErrors(this);
     d_hl = new EbnfHighlighter( document() );
+    d_pool.setMaxThreadCount(1);
 	updateTabWidth();
 
 }
 
+EbnfEditor::~EbnfEditor()
+{
+    cancelParse();
+}
+
 void EbnfEditor::markNonTerms(const SymList& syms)
 {
     d_nonTerms.clear();
@@ -144,7 +150,7 @@ void EbnfEditor::mousePressEvent(QMouseEvent* e)
         QApplication::restoreOverrideCursor();
         d_link.clear();
         setCursorPosition( d_linkLineNr, 0, true );
-    }else if( QApplication::keyboardModifiers() == Qt::ControlModifier )
+    }else if( QApplication::keyboardModifiers() == Qt::ControlModifier && d_syn.constData() )
     {
         QTextCursor cur = cursorForPosition(e->pos());
         const Ast::Symbol* sym = d_syn->findSymbolBySourcePos(cur.blockNumber() + 1,cur.positionInBlock() + 1);
@@ -201,40 +207,80 @@ void EbnfEditor::mouseMoveEvent(QMouseEvent* e)
 }
 
 void EbnfEditor::onUpdateModel()
+{
+    if( d_job != 0 )
+    {
+        // the running job is superseded; the next one starts as soon as it gives up
+        d_job->cancel();
+        d_pending = true;
+    }else
+        startParse();
+}
+
+void EbnfEditor::reparse()
 {
     parseText( toPlainText().toUtf8() );
 }
 
 void EbnfEditor::parseText(QByteArray ba)
 {
-    QBuffer buf(&ba);
-    buf.open(QIODevice::ReadOnly );
-    EbnfLexer l;
-    l.setKeywords( d_origKeyWords );
-    EbnfParser p;
-    p.setErrors(d_errs);
+    cancelParse();
+    // releases the symbols only used by syntaxes which are gone since the last parse
+    EbnfToken::resetSymTbl();
+    EbnfParseJob job( ba, d_origKeyWords, d_syn, 0 );
+    job.run();
+    publish( &job );
+}
+
+void EbnfEditor::startParse()
+{
+    Q_ASSERT( d_job == 0 );
+    // releases the symbols only used by syntaxes which are gone since the last parse; the symbols of a
+    // running job are kept by the generation of its syntax
+    EbnfToken::resetSymTbl();
+    d_job = new EbnfParseJob( toPlainText().toUtf8(), d_origKeyWords, d_syn, this );
+    d_pool.start( d_job );
+}
+
+void EbnfEditor::cancelParse()
+{
+    if( d_job == 0 )
+        return;
+    d_job->cancel();
+    d_pool.waitForDone();
+    delete d_job;
+    d_job = 0;
+    d_pending = false;
+}
+
+void EbnfEditor::onParsed()
+{
+    if( d_job == 0 || !d_job->isDone() )
+        return; // the job this notification is from was already waited for by parseText
+    EbnfParseJob* job = d_job;
+    d_job = 0;
+    if( !job->isCancelled() )
+        publish( job );
+    delete job;
+    if( d_pending )
+    {
+        d_pending = false;
+        startParse();
+    }
+}
+
+void EbnfEditor::publish(EbnfParseJob* job)
+{
     d_errs->clear();
+    d_errs->replay( job->d_errs.getBuffer() );
     d_nonTerms.clear();
-    d_syn = 0;
-    l.setStream( &buf );
-    if( !p.parse( &l ) )
-    {
-        //qDebug() << "parsing" << d_path << "not successful," << d_errs->getErrCount() << "errors";
-        // qDebug() << p.getErrors();
-    }else
+    d_syn = job->d_syn;
+    if( d_syn.constData() != 0 )
     {
-        d_syn = p.getSyntax();
-        if( d_syn->finishSyntax() )
-        {
-            //qDebug() << "parsing" << d_path << "successful, no errors";
-        }else
-        {
-            //qDebug() << "parsing" << d_path << "not successful," << d_errs->getErrCount() << "errors";
-            // qDebug() << p.getSyntax()->getErrors();
-        }
-        if( l.getKeywords().size() != d_hl->getKeywords().size() )
+        d_syn->setErrs( d_errs );
+        if( job->d_keywords.size() != d_hl->getKeywords().size() )
         {
-            d_hl->setKeywords( l.getKeywords() );
+            d_hl->setKeywords( job->d_keywords );
             //d_rehighlightLock = true;
             d_hl->rehighlight(); // triggert onTextChanged
             //d_rehighlightLock = false;
@@ -242,7 +288,7 @@ void EbnfEditor::parseText(QByteArray ba)
     }
     emit sigSyntaxUpdated();
     updateExtraSelections();
-    //p.getSyntax()->dump();
+    //d_syn->dump();
 }
 
 bool EbnfEditor::loadFromFile(const QString &path)
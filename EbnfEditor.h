@@ -23,6 +23,7 @@
 #include <QPlainTextEdit>
 #include <QSet>
 #include <QTimer>
+#include <QThreadPool>
 #include <GuiTools/CodeEditor.h>
 #include "EbnfSyntax.h"
 
@@ -30,19 +31,23 @@
 
 class EbnfHighlighter;
 class EbnfErrors;
+class EbnfParseJob;
 
 class EbnfEditor : public CodeEditor
 {
     Q_OBJECT
 public:
     explicit EbnfEditor(QWidget *parent = 0);
+    ~EbnfEditor();
 
     bool loadFromFile(const QString& path );
     bool loadKeywords(const QString& path );
     void newFile();
     bool saveToFile( const QString& path );
     EbnfSyntax* getSyntax() const { return d_syn.data(); }
+    bool isSyntaxFinished() const { return d_syn.constData() != 0 && d_syn->isFinished(); } // see analysis and generators
     EbnfErrors* getErrs() const { return d_errs; }
+    void reparse(); // waits for the result
 
     bool hasSelection() const;
     QString selectedText() const;
@@ -56,15 +61,24 @@ signals:
 
 public slots:
 
+protected slots:
+    void onParsed();
+
 protected:
     void mousePressEvent(QMouseEvent* e);
     void mouseMoveEvent(QMouseEvent* e);
     void onUpdateModel();
     void parseText(QByteArray ba);
+    void startParse();
+    void cancelParse();
+    void publish( EbnfParseJob* );
 private:
     EbnfHighlighter* d_hl;
     EbnfErrors* d_errs;
     EbnfSyntaxRef d_syn;
+    QThreadPool d_pool;
+    EbnfParseJob* d_job; // running in d_pool or done and not yet published
+    bool d_pending; // the text changed while d_job was running
     typedef QSet<EbnfToken::Sym> Keywords;
     Keywords d_origKeyWords;
 };
@@ -20,7 +20,7 @@
 #include "EbnfErrors.h"
 #include <QtDebug>
 
-EbnfErrors::EbnfErrors(QObject *parent) : QObject(parent),d_reportToConsole(false),d_errCounter(0)
+EbnfErrors::EbnfErrors(QObject *parent) : QObject(parent),d_reportToConsole(false),d_errCounter(0),d_buffered(false)
 {
     d_eventLatency.setSingleShot(true);
     connect(&d_eventLatency, SIGNAL(timeout()), this, SIGNAL(sigChanged()));
@@ -38,6 +38,12 @@ void EbnfErrors::error(EbnfErrors::Source src, int line, int col, const QString&
         e.d_source = src;
         e.d_isErr = true;
         e.d_data = data;
+        if( d_buffered )
+        {
+            d_buffer.append(e);
+            d_errCounter++;
+            return;
+        }
         const int count = d_errs.size();
         d_errs.insert(e);
         inserted = count != d_errs.size();
@@ -67,6 +73,11 @@ void EbnfErrors::warning(EbnfErrors::Source src, int line, int col, const QStrin
             e.d_source = src;
             e.d_isErr = false;
             e.d_data = data;
+            if( d_buffered )
+            {
+                d_buffer.append(e);
+                return;
+            }
             const int count = d_errs.size();
             d_errs.insert(e);
             inserted = count != d_errs.size();
@@ -78,9 +89,21 @@ void EbnfErrors::warning(EbnfErrors::Source src, int line, int col, const QStrin
     }
 }
 
+void EbnfErrors::replay(const EbnfErrors::EntryBuffer& buf)
+{
+    foreach( const Entry& e, buf )
+    {
+        if( e.d_isErr )
+            error( Source(e.d_source), e.d_line, e.d_col, e.d_msg, e.d_data );
+        else
+            warning( Source(e.d_source), e.d_line, e.d_col, e.d_msg, e.d_data );
+    }
+}
+
 void EbnfErrors::clear()
 {
     d_errs.clear();
+    d_buffer.clear();
     d_errCounter = 0;
     notify();
 }
@@ -46,6 +46,7 @@ public:
         }
     };
     typedef QSet<Entry> EntryList;
+    typedef QList<Entry> EntryBuffer;
 
     explicit EbnfErrors(QObject *parent = 0);
 
@@ -53,6 +54,12 @@ public:
     void warning( Source, int line, int col, const QString& msg, const QVariant& = QVariant() );
     void clear();
 
+    // a buffered instance only collects the entries in order of occurrence without notification,
+    // so it can be filled by a worker thread and later replayed to the visible instance
+    void setBuffered( bool on ) { d_buffered = on; }
+    const EntryBuffer& getBuffer() const { return d_buffer; }
+    void replay( const EntryBuffer& );
+
     const EntryList& getErrors() const { return d_errs; }
     void resetErrCount() { d_errCounter = 0; }
     quint16 getErrCount() const { return d_errCounter; }
@@ -66,8 +73,10 @@ protected:
 private:
     QTimer d_eventLatency;
     EntryList d_errs;
+    EntryBuffer d_buffer;
     quint16 d_errCounter;
     bool d_reportToConsole;
+    bool d_buffered;
 };
 
 inline uint qHash(const EbnfErrors::Entry & e, uint seed = 0) {
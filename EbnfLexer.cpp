@@ -18,30 +18,49 @@
 */
 
 #include "EbnfLexer.h"
+#include "EbnfProfiler.h"
 #include <QIODevice>
 #include <QBuffer>
 #include <QFile>
 #include <QtDebug>
+#include <string.h>
+
+static EbnfProfiler::Site s_lexerSite("lexer");
+
+static inline bool isLetterOrNumber( uint ch )
+{
+    if( ch < 0x80 )
+        return ( ch >= 'a' && ch <= 'z' ) || ( ch >= 'A' && ch <= 'Z' ) || ( ch >= '0' && ch <= '9' );
+    return QChar::isLetterOrNumber(ch);
+}
+
+static inline bool isSpace( uint ch )
+{
+    if( ch < 0x80 )
+        return ch == ' ' || ( ch >= 0x09 && ch <= 0x0d );
+    return QChar::isSpace(ch);
+}
 
 EbnfLexer::EbnfLexer(QObject *parent) : QObject(parent),
-    d_lastToken(EbnfToken::Invalid),d_lineNr(0),d_colNr(0),d_in(0)
+    d_lastToken(EbnfToken::Invalid),d_lineNr(0),d_colNr(0),d_in(0),d_next(0),d_end(0),d_line(0),
+    d_lineLen(0),d_pos(0),d_buffered(false)
 {
 
 }
 
 EbnfToken EbnfLexer::nextTokenImp()
 {
-    if( d_in == 0 )
+    if( d_in == 0 && !d_buffered )
         return token(EbnfToken::Eof);
     skipWhiteSpace();
 
     bool potentialProduction = false;
-    while( d_colNr >= d_line.size() )
+    while( d_pos >= d_lineLen )
     {
-        if( d_in->atEnd() )
+        if( atEnd() )
         {
             EbnfToken t = token( EbnfToken::Eof, 0 );
-            if( d_in->parent() == this )
+            if( d_in && d_in->parent() == this )
             {
                 d_in->deleteLater();
                 d_in = 0;
@@ -52,18 +71,19 @@ EbnfToken EbnfLexer::nextTokenImp()
         potentialProduction = ( skipWhiteSpace() == 0 );
     }
 
-    Q_ASSERT( d_colNr < d_line.size() );
-    while( d_colNr < d_line.size() )
+    Q_ASSERT( d_pos < d_lineLen );
+    while( d_pos < d_lineLen )
     {
-        const QChar ch = d_line[d_colNr];
+        int len;
+        const uint ch = charAt( d_pos, len );
 
         if( ch == '/' && lookAhead(1) == '/' )
-            return token(EbnfToken::Comment, d_line.size() - d_colNr, d_line.mid( d_colNr + 2 ).trimmed().toUtf8() );
+            return token(EbnfToken::Comment, d_lineLen - d_pos, trimmed( d_pos + 2, d_lineLen - d_pos - 2 ) );
 
-        if( d_colNr == 0 && ch == '#' )
+        if( d_pos == 0 && ch == '#' )
         {
             return ppsym();
-        }else if( ch.isLetterOrNumber() || ch == '$' || ch == '%' )
+        }else if( isLetterOrNumber(ch) || ch == '$' || ch == '%' )
         {
             // Identifier oder Reserved Word
             EbnfToken t = ident();
@@ -78,7 +98,7 @@ EbnfToken EbnfLexer::nextTokenImp()
                 }
             }else
             {
-                if( d_kw.contains(t.d_val) )
+                if( isKeyword(t.d_val) )
                     t.d_type = EbnfToken::Keyword;
                 return t;
             }
@@ -90,7 +110,7 @@ EbnfToken EbnfLexer::nextTokenImp()
         if( potentialProduction )
             return token( EbnfToken::Invalid, 0, "production or comment expected" );
 
-        switch( ch.unicode() )
+        switch( ch )
         {
         case ':':
             if( lookAhead(1) == ':' && lookAhead(2) == '=' )
@@ -121,7 +141,8 @@ EbnfToken EbnfLexer::nextTokenImp()
         }else
         {
             // Error
-            return token( EbnfToken::Invalid, 0, QString("unexpected character '%1' %2").arg(ch).arg(ch.unicode()).toUtf8() );
+            const QChar qch = QString::fromUtf8( d_line + d_pos, len ).at(0);
+            return token( EbnfToken::Invalid, 0, QString("unexpected character '%1' %2").arg(qch).arg(qch.unicode()).toUtf8() );
         }
     }
     Q_ASSERT(false);
@@ -135,10 +156,7 @@ QList<EbnfToken> EbnfLexer::tokens(const QString& code)
 
 QList<EbnfToken> EbnfLexer::tokens(const QByteArray& code)
 {
-    QBuffer in;
-    in.setData( code );
-    in.open(QIODevice::ReadOnly);
-    setStream( &in );
+    setBuffer( code );
 
     QList<EbnfToken> res;
     EbnfToken t = nextToken();
@@ -156,6 +174,43 @@ void EbnfLexer::setStream(QIODevice* in)
     d_lineNr = 0;
     d_colNr = 0;
     d_lastToken = EbnfToken::Invalid;
+    d_data.clear();
+    d_line = 0;
+    d_lineLen = 0;
+    d_pos = 0;
+    d_buffered = false;
+    if( in == 0 )
+        return;
+
+    // scan buffers and mappable files in place instead of reading and copying line by line
+    const qint64 pos = in->pos();
+    const char* data = 0;
+    qint64 size = 0;
+    if( QBuffer* buf = qobject_cast<QBuffer*>(in) )
+    {
+        data = buf->data().constData();
+        size = buf->data().size();
+    }else if( QFile* file = qobject_cast<QFile*>(in) )
+    {
+        size = file->size();
+        if( size > 0 )
+            data = reinterpret_cast<const char*>( file->map( 0, size ) );
+    }
+    if( data != 0 && pos <= size )
+    {
+        d_next = data + pos;
+        d_end = data + size;
+        d_buffered = true;
+    }
+}
+
+void EbnfLexer::setBuffer(const QByteArray& code)
+{
+    setStream(0);
+    d_data = code;
+    d_next = d_data.constData();
+    d_end = d_next + d_data.size();
+    d_buffered = true;
 }
 
 bool EbnfLexer::readKeywordsFromFile(const QString& path)
@@ -169,11 +224,27 @@ bool EbnfLexer::readKeywordsFromFile(const QString& path)
     {
         d_kw.insert( EbnfToken::getSym(kw[i].toUtf8()) );
     }
+    updateKwIds();
     return true;
 }
 
+void EbnfLexer::updateKwIds()
+{
+    quint32 max = 0;
+    foreach( const EbnfToken::Sym& sym, d_kw )
+        max = qMax( max, sym.getId() );
+    d_kwIds = QBitArray( max + 1 );
+    foreach( const EbnfToken::Sym& sym, d_kw )
+    {
+        // keyword sets are passed on to highlighters and other lexers, independent of any syntax
+        EbnfToken::pinSym( sym );
+        d_kwIds.setBit( sym.getId() );
+    }
+}
+
 EbnfToken EbnfLexer::nextToken()
 {
+    EbnfProfiler::SiteScope prof(s_lexerSite);
     EbnfToken t;
     if( !d_buffer.isEmpty() )
     {
@@ -187,6 +258,7 @@ EbnfToken EbnfLexer::nextToken()
 EbnfToken EbnfLexer::peekToken(quint8 lookAhead)
 {
     Q_ASSERT( lookAhead > 0 );
+    EbnfProfiler::SiteScope prof(s_lexerSite);
     while( d_buffer.size() < lookAhead )
         d_buffer.push_back( nextTokenImp() );
     return d_buffer[ lookAhead - 1 ];
@@ -194,57 +266,184 @@ EbnfToken EbnfLexer::peekToken(quint8 lookAhead)
 
 int EbnfLexer::skipWhiteSpace()
 {
-    const int colNr = d_colNr;
-    while( d_colNr < d_line.size() && d_line[d_colNr].isSpace() )
-        d_colNr++;
-    return d_colNr - colNr;
+    const int pos = d_pos;
+    while( d_pos < d_lineLen )
+    {
+        const uchar ch = d_line[d_pos];
+        if( ch < 0x80 )
+        {
+            if( !isSpace(ch) )
+                break;
+            d_pos++;
+            d_colNr++;
+        }else
+        {
+            int len;
+            if( !isSpace( charAt( d_pos, len ) ) )
+                break;
+            d_colNr += utf16Len( d_pos, len );
+            d_pos += len;
+        }
+    }
+    return d_pos - pos;
 }
 
 EbnfToken EbnfLexer::token(EbnfToken::TokenType tt, int len, const QByteArray& val)
 {
-    EbnfToken t( tt, d_lineNr, d_colNr + 1, len, val );
+    // len is in bytes; unterminated literals and predicates count one beyond the end of the line
+    const int avail = qMin( len, d_lineLen - d_pos );
+    const int units = avail > 0 ? utf16Len( d_pos, avail ) + len - avail : len;
+    EbnfToken t( tt, d_lineNr, d_colNr + 1, units, val );
     d_lastToken = t;
-    d_colNr += len;
+    d_pos += len;
+    d_colNr += units;
     return t;
 }
 
 int EbnfLexer::lookAhead(int off) const
 {
-    if( int( d_colNr + off ) < d_line.size() )
+    // only used to compare with ASCII characters, so the bytes suffice
+    if( d_pos + off < d_lineLen )
     {
-        return d_line[ d_colNr + off ].unicode();
+        return uchar( d_line[ d_pos + off ] );
     }else
         return 0;
 }
 
+bool EbnfLexer::atEnd() const
+{
+    if( d_buffered )
+        return d_next >= d_end;
+    else
+        return d_in->atEnd();
+}
+
+uint EbnfLexer::charAt(int pos, int& len) const
+{
+    // characters outside the BMP are reported by their high surrogate, which is neither a letter
+    // nor a space; malformed sequences are single replacement characters
+    const uchar* s = reinterpret_cast<const uchar*>( d_line + pos );
+    const int avail = d_lineLen - pos;
+    len = 1;
+    if( s[0] < 0x80 )
+        return s[0];
+    if( s[0] >= 0xc2 && s[0] < 0xe0 && avail >= 2 && ( s[1] & 0xc0 ) == 0x80 )
+    {
+        len = 2;
+        return ( ( s[0] & 0x1f ) << 6 ) | ( s[1] & 0x3f );
+    }
+    if( s[0] >= 0xe0 && s[0] < 0xf0 && avail >= 3 && ( s[1] & 0xc0 ) == 0x80 && ( s[2] & 0xc0 ) == 0x80 )
+    {
+        const uint ch = ( ( s[0] & 0x0f ) << 12 ) | ( ( s[1] & 0x3f ) << 6 ) | ( s[2] & 0x3f );
+        if( ch >= 0x800 && ( ch < 0xd800 || ch > 0xdfff ) )
+        {
+            len = 3;
+            return ch;
+        }
+    }else if( s[0] >= 0xf0 && s[0] < 0xf5 && avail >= 4 && ( s[1] & 0xc0 ) == 0x80 &&
+              ( s[2] & 0xc0 ) == 0x80 && ( s[3] & 0xc0 ) == 0x80 )
+    {
+        const uint ch = ( ( s[0] & 0x07 ) << 18 ) | ( ( s[1] & 0x3f ) << 12 ) | ( ( s[2] & 0x3f ) << 6 ) |
+                ( s[3] & 0x3f );
+        if( ch >= 0x10000 && ch <= 0x10ffff )
+        {
+            len = 4;
+            return QChar::highSurrogate(ch);
+        }
+    }
+    return 0xfffd;
+}
+
+int EbnfLexer::utf16Len(int pos, int len) const
+{
+    int units = 0;
+    const int end = pos + len;
+    while( pos < end )
+    {
+        if( uchar( d_line[pos] ) < 0x80 )
+        {
+            pos++;
+            units++;
+        }else
+        {
+            int n;
+            charAt( pos, n );
+            units += ( n == 4 ? 2 : 1 );
+            pos += n;
+        }
+    }
+    return units;
+}
+
+QByteArray EbnfLexer::trimmed(int pos, int len) const
+{
+    int end = pos + len;
+    while( pos < end && uchar( d_line[pos] ) < 0x80 && isSpace( uchar( d_line[pos] ) ) )
+        pos++;
+    while( end > pos && uchar( d_line[end-1] ) < 0x80 && isSpace( uchar( d_line[end-1] ) ) )
+        end--;
+    if( pos < end && ( uchar( d_line[pos] ) >= 0x80 || uchar( d_line[end-1] ) >= 0x80 ) )
+        // rare; let QString deal with non-ASCII white space
+        return QString::fromUtf8( d_line + pos, end - pos ).trimmed().toUtf8();
+    return slice( pos, end - pos );
+}
+
 void EbnfLexer::nextLine()
 {
+    d_pos = 0;
     d_colNr = 0;
     d_lineNr++;
-    d_line = d_in->readLine();
+
+    const char* start;
+    const char* end;
+    bool newline;
+    if( d_buffered )
+    {
+        start = d_next;
+        const char* nl = static_cast<const char*>( ::memchr( start, '\n', d_end - start ) );
+        newline = nl != 0;
+        end = newline ? nl : d_end;
+        d_next = newline ? nl + 1 : d_end;
+    }else
+    {
+        d_data = d_in->readLine();
+        start = d_data.constData();
+        end = start + d_data.size();
+        newline = end > start && end[-1] == '\n';
+        if( newline )
+            end--;
+    }
 
     // see https://de.wikipedia.org/wiki/Zeilenumbruch
-    if( d_line.endsWith("\r\n") )
-        d_line.chop(2);
-    else if( d_line.endsWith('\n') || d_line.endsWith('\r') || d_line.endsWith('\025') )
-        d_line.chop(1);
+    if( newline )
+    {
+        if( end > start && end[-1] == '\r' )
+            end--;
+    }else if( end > start && ( end[-1] == '\r' || end[-1] == '\025' ) )
+        end--;
 
+    // like QString::fromUtf8 ignore a byte order mark
+    if( end - start >= 3 && uchar(start[0]) == 0xef && uchar(start[1]) == 0xbb && uchar(start[2]) == 0xbf )
+        start += 3;
+
+    d_line = start;
+    d_lineLen = end - start;
 }
 
 EbnfToken EbnfLexer::ident()
 {
-    int off = 1; // off == 0 wurde bereits dem ident zugeordnet
-    while( true )
+    int off;
+    charAt( d_pos, off ); // der erste Char wurde bereits dem ident zugeordnet
+    while( d_pos + off < d_lineLen )
     {
-        if( (d_colNr+off) >= d_line.size() ||
-                ( !d_line[d_colNr+off].isLetterOrNumber() && d_line[d_colNr+off] != '_' &&
-                  d_line[d_colNr+off] != '$' ) ) // hier darf '-' nicht wie '$' behandelt werden, sonst wird - Teil des Idents!
+        int len;
+        const uint ch = charAt( d_pos + off, len );
+        if( !isLetterOrNumber(ch) && ch != '_' && ch != '$' ) // hier darf '-' nicht wie '$' behandelt werden, sonst wird - Teil des Idents!
             break;
         else
-            off++;
+            off += len;
     }
-    const QByteArray str = d_line.mid(d_colNr, off ).toUtf8();
-    EbnfToken t = token( EbnfToken::NonTerm, off, str ); // ob es sich um ein KeyWord handelt, wird später entschieden
+    EbnfToken t = token( EbnfToken::NonTerm, off, slice( d_pos, off ) ); // ob es sich um ein KeyWord handelt, wird später entschieden
     t.d_op = readOp();
     return t;
 }
@@ -254,30 +453,36 @@ EbnfToken EbnfLexer::attribute()
     int off = 1;
     while( true )
     {
-        if( (d_colNr+off) >= d_line.size() || d_line[d_colNr+off] == '\\' )
+        if( (d_pos+off) >= d_lineLen || d_line[d_pos+off] == '\\' )
             break;
         else
             off++;
     }
-    const QByteArray str = d_line.mid(d_colNr + 1, off - 1 ).toUtf8();
-    return token( EbnfToken::Predicate, off+1, str );
+    return token( EbnfToken::Predicate, off+1, slice( d_pos + 1, off - 1 ) );
 }
 
 EbnfToken EbnfLexer::literal()
 {
     int off = 1;
+    bool escaped = false;
     while( true )
     {
-        if( (d_colNr+off) < d_line.size() && d_line[d_colNr+off] == '\\' )
+        if( (d_pos+off) < d_lineLen && d_line[d_pos+off] == '\\' )
+        {
             off++;
-        else if( (d_colNr+off) >= d_line.size() || d_line[d_colNr+off] == '\'' )
+            escaped = true;
+        }else if( (d_pos+off) >= d_lineLen || d_line[d_pos+off] == '\'' )
             break;
         off++;
     }
-    QString str = d_line.mid(d_colNr + 1, off - 1 );
-    str.replace("\\'", "'");
-    str.replace("\\\\", "\\");
-    EbnfToken t = token( EbnfToken::Literal, off+1, str.toUtf8() ); // remove enclosing ''
+    QByteArray str = slice( d_pos + 1, off - 1 );
+    if( escaped )
+    {
+        str = QByteArray( str.constData(), str.size() );
+        str.replace("\\'", "'");
+        str.replace("\\\\", "\\");
+    }
+    EbnfToken t = token( EbnfToken::Literal, off+1, str ); // remove enclosing ''
     t.d_op = readOp();
     return t;
 }
@@ -287,12 +492,13 @@ EbnfToken EbnfLexer::ppsym()
     int off = 1; // off == 0 wurde bereits dem ident zugeordnet
     while( true )
     {
-        if( (d_colNr+off) >= d_line.size() || !d_line[d_colNr+off].isLetterOrNumber() )
+        int len;
+        if( (d_pos+off) >= d_lineLen || !isLetterOrNumber( charAt( d_pos + off, len ) ) )
             break;
         else
-            off++;
+            off += len;
     }
-    const QByteArray keyword = d_line.mid(d_colNr, off ).toUtf8();
+    const QByteArray keyword = slice( d_pos, off );
     EbnfToken::TokenType tt = EbnfToken::Invalid;
     if( keyword == "#define" )
         tt = EbnfToken::PpDefine;
@@ -307,30 +513,32 @@ EbnfToken EbnfLexer::ppsym()
     else if( keyword == "#endif")
         tt = EbnfToken::PpEndif;
     if( tt == EbnfToken::Invalid )
-        return token( EbnfToken::Invalid, 0, QString("invalid preprocessor symbol '%1'").arg(keyword.data()).toUtf8() );
-    const int cmtPos = d_line.indexOf("//", off);
-    const QString str = ( cmtPos == -1 ? d_line.mid(off) : d_line.mid(off,cmtPos-off) ).trimmed();
-    return token( tt, d_line.size(), str.toUtf8() );
+        return token( EbnfToken::Invalid, 0, QString("invalid preprocessor symbol '%1'").arg(QString::fromUtf8(keyword)).toUtf8() );
+    int cmtPos = off;
+    while( cmtPos < d_lineLen && !( d_line[cmtPos] == '/' && cmtPos + 1 < d_lineLen && d_line[cmtPos+1] == '/' ) )
+        cmtPos++;
+    return token( tt, d_lineLen, trimmed( off, cmtPos - off ) );
 }
 
 EbnfToken::Handling EbnfLexer::readOp()
 {
-    if( d_colNr < d_line.size() )
+    if( d_pos < d_lineLen )
     {
-        switch( d_line[d_colNr].unicode() )
+        switch( d_line[d_pos] )
         {
         case '*':
+            d_pos++;
             d_colNr++;
             return EbnfToken::Transparent;
         case '!':
+            d_pos++;
             d_colNr++;
             return EbnfToken::Keep;
         case '-':
+            d_pos++;
             d_colNr++;
             return EbnfToken::Skip;
         }
     }
     return EbnfToken::Normal;
 }
-
-
@@ -22,10 +22,15 @@
 
 #include <QObject>
 #include <QSet>
+#include <QBitArray>
 #include "EbnfToken.h"
 
 class QIODevice;
 
+// Scans UTF-8 bytes directly; columns and token lengths are counted in UTF-16 code units as
+// in the QTextDocument. Input from a QBuffer, a mappable QFile or setBuffer is scanned in place,
+// other devices are read line by line.
+
 class EbnfLexer : public QObject
 {
 public:
@@ -33,10 +38,13 @@ public:
     explicit EbnfLexer(QObject *parent = 0);
 
     void setStream( QIODevice* );
+    void setBuffer( const QByteArray& ); // utf-8, shallow copy
 
-    void setKeywords( const Keywords& kw ) { d_kw = kw; }
-    void addKeywords( const Keywords& kw ) { d_kw += kw; }
+    void setKeywords( const Keywords& kw ) { d_kw = kw; updateKwIds(); }
+    void addKeywords( const Keywords& kw ) { d_kw += kw; updateKwIds(); }
     const Keywords& getKeywords() const { return d_kw; }
+    bool isKeyword( const EbnfToken::Sym& sym ) const
+        { const quint32 i = sym.getId(); return i < quint32(d_kwIds.size()) && d_kwIds.testBit(i); }
     bool readKeywordsFromFile( const QString& path );
 
     EbnfToken nextToken();
@@ -54,15 +62,28 @@ protected:
     EbnfToken ppsym();
     EbnfToken::Handling readOp();
     void nextLine();
+    bool atEnd() const;
+    uint charAt( int pos, int& len ) const;
+    int utf16Len( int pos, int len ) const;
+    QByteArray slice( int pos, int len ) const { return QByteArray::fromRawData( d_line + pos, len ); }
+    QByteArray trimmed( int pos, int len ) const;
+    void updateKwIds();
 
 private:
     QIODevice* d_in;
+    QByteArray d_data;  // the whole input in buffer mode, otherwise the current line
+    const char* d_next; // start of the next line in buffer mode
+    const char* d_end;  // end of the input in buffer mode
+    const char* d_line; // current line without terminator
+    int d_lineLen;      // in bytes
+    int d_pos;          // byte offset of the current char in d_line
     quint32 d_lineNr; // current line, starting with 1
-    quint16 d_colNr;  // current column (left of char), starting with 0
-    QString d_line;
+    quint16 d_colNr;  // current column (left of char) in UTF-16 code units, starting with 0
+    bool d_buffered;
     EbnfToken d_lastToken;
     QList<EbnfToken> d_buffer;
     Keywords d_kw;
+    QBitArray d_kwIds; // EbnfToken::Sym::getId() of d_kw
 };
 
 #endif // EBNFLEXER_H
@@ -0,0 +1,54 @@
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "EbnfParseJob.h"
+#include "EbnfParser.h"
+#include <QBuffer>
+
+EbnfParseJob::EbnfParseJob(const QByteArray& text, const EbnfLexer::Keywords& kw, const EbnfSyntaxRef& prev,
+                           QObject* notify):
+    d_text(text),d_keywords(kw),d_prev(prev),d_notify(notify)
+{
+    setAutoDelete(false);
+    d_errs.setBuffered(true);
+}
+
+void EbnfParseJob::run()
+{
+    QBuffer buf(&d_text);
+    buf.open(QIODevice::ReadOnly );
+    EbnfLexer l;
+    l.setKeywords( d_keywords );
+    l.setStream( &buf );
+    EbnfParser p;
+    p.setErrors(&d_errs);
+    p.setCancel(&d_cancel);
+    if( p.parse( &l ) && !d_cancel.load() )
+    {
+        EbnfSyntaxRef syn = p.getSyntax();
+        // only the productions affected by the edit are analyzed again; a syntax with unresolved references
+        // is not analyzed, but still published for the navigation and the tree, see EbnfSyntax::isFinished
+        syn->finishSyntax( d_prev.data() );
+        d_syn = syn;
+        d_keywords = l.getKeywords();
+    }
+    d_done.store(1);
+    if( d_notify )
+        QMetaObject::invokeMethod( d_notify, "onParsed", Qt::QueuedConnection );
+}
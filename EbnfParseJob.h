@@ -0,0 +1,51 @@
+#ifndef EBNFPARSEJOB_H
+#define EBNFPARSEJOB_H
+
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QRunnable>
+#include <QAtomicInt>
+#include "EbnfLexer.h"
+#include "EbnfErrors.h"
+#include "EbnfSyntax.h"
+
+// Lexes, parses and analyzes a snapshot of the text in a worker thread. The previous syntax is only read, so
+// the editor can go on using it until the result is published in the GUI thread. The issues are collected in
+// a buffer and replayed to the errors of the editor together with the new syntax.
+class EbnfParseJob : public QRunnable
+{
+public:
+    EbnfParseJob( const QByteArray& text, const EbnfLexer::Keywords& kw, const EbnfSyntaxRef& prev, QObject* notify );
+    void run();
+    void cancel() { d_cancel.store(1); }
+    bool isCancelled() const { return d_cancel.load(); }
+    bool isDone() const { return d_done.load(); }
+
+    QByteArray d_text;
+    EbnfLexer::Keywords d_keywords; // the ones of the lexer after parsing
+    EbnfSyntaxRef d_prev;
+    EbnfSyntaxRef d_syn; // 0 if not parsed; not finished if there are unresolved symbols
+    EbnfErrors d_errs;
+    QAtomicInt d_cancel;
+    QAtomicInt d_done;
+    QObject* d_notify;
+};
+
+#endif // EBNFPARSEJOB_H
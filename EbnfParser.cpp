@@ -22,7 +22,7 @@
 #include "EbnfErrors.h"
 #include "LaParser.h"
 
-EbnfParser::EbnfParser(QObject *parent) : QObject(parent),d_lex(0),d_def(0),d_errs(0)
+EbnfParser::EbnfParser(QObject *parent) : QObject(parent),d_lex(0),d_def(0),d_errs(0),d_cancel(0)
 {
 
 }
@@ -30,6 +30,7 @@ EbnfParser::EbnfParser(QObject *parent) : QObject(parent),d_lex(0),d_def(0),d_er
 bool EbnfParser::parse(EbnfLexer* lex)
 {
     Q_ASSERT( lex != 0 );
+    EbnfProfiler::Scope prof("parse");
     d_lex = lex;
     if( d_errs )
         d_errs->resetErrCount();
@@ -40,12 +41,14 @@ bool EbnfParser::parse(EbnfLexer* lex)
     EbnfToken t = nextToken();
     while( t.isValid() )
     {
+        if( d_cancel != 0 && d_cancel->load() )
+            return false;
         if( t.d_type == EbnfToken::Production )
         {
             EbnfToken op = nextToken();
             if( op.d_type == EbnfToken::Assig )
             {
-                d_def = new Ast::Definition(t);
+                d_def = new( d_syn->getArena() ) Ast::Definition(t);
                 if( !d_syn->addDef( d_def ) )
                 {
                     delete d_def;
@@ -130,11 +133,11 @@ Ast::Node*EbnfParser::parseFactor()
     {
     case EbnfToken::Keyword:
     case EbnfToken::Literal:
-        node = new Ast::Node( Ast::Node::Terminal, d_def, d_cur, d_cur.d_type == EbnfToken::Literal );
+        node = new( d_syn->getArena() ) Ast::Node( Ast::Node::Terminal, d_def, d_cur, d_cur.d_type == EbnfToken::Literal );
         nextToken();
         break;
     case EbnfToken::NonTerm:
-        node = new Ast::Node( Ast::Node::Nonterminal, d_def, d_cur );
+        node = new( d_syn->getArena() ) Ast::Node( Ast::Node::Nonterminal, d_def, d_cur );
         nextToken();
         break;
     case EbnfToken::LBrack:
@@ -148,7 +151,6 @@ Ast::Node*EbnfParser::parseFactor()
             if( d_cur.d_type != EbnfToken::RBrack )
             {
                 error( d_cur, "expecting ']'" );
-                delete node;
                 return 0;
             }
             if( !checkCardinality(node) )
@@ -168,7 +170,6 @@ Ast::Node*EbnfParser::parseFactor()
             if( d_cur.d_type != EbnfToken::RPar )
             {
                 error( d_cur, "expecting ')'" );
-                delete node;
                 return 0;
             }
             if( !checkCardinality(node) )
@@ -188,7 +189,6 @@ Ast::Node*EbnfParser::parseFactor()
             if( d_cur.d_type != EbnfToken::RBrace )
             {
                 error( d_cur, "expecting '}'" );
-                delete node;
                 return 0;
             }
             if( !checkCardinality(node) )
@@ -235,21 +235,16 @@ Ast::Node*EbnfParser::parseExpression()
         nextToken();
         if( alternative == 0 )
         {
-            alternative = new Ast::Node( Ast::Node::Alternative, d_def );
+            alternative = new( d_syn->getArena() ) Ast::Node( Ast::Node::Alternative, d_def );
             alternative->d_tok.d_lineNr = first.d_lineNr;
             alternative->d_tok.d_colNr = first.d_colNr;
-            alternative->d_subs.append(node);
-            node->d_parent = alternative;
+            alternative->append(d_syn->getArena(), node);
             node = alternative;
         }
         Ast::Node* n = parseTerm();
         if( n == 0 )
-        {
-            delete node;
             return 0;
-        }
-        alternative->d_subs.append(n);
-        n->d_parent = alternative;
+        alternative->append(d_syn->getArena(), n);
     }
     return node;
 }
@@ -289,13 +284,11 @@ Ast::Node*EbnfParser::parseTerm()
     Ast::Node* sequence = 0;
     if( pred.isValid() )
     {
-        sequence = new Ast::Node( Ast::Node::Sequence, d_def );
+        sequence = new( d_syn->getArena() ) Ast::Node( Ast::Node::Sequence, d_def );
         sequence->d_tok.d_lineNr = first.d_lineNr;
         sequence->d_tok.d_colNr = first.d_colNr;
-        sequence->d_subs.append(new Ast::Node( Ast::Node::Predicate, d_def, pred ));
-        sequence->d_subs.back()->d_parent = sequence;
-        sequence->d_subs.append(node);
-        node->d_parent = sequence;
+        sequence->append(d_syn->getArena(), new( d_syn->getArena() ) Ast::Node( Ast::Node::Predicate, d_def, pred ));
+        sequence->append(d_syn->getArena(), node);
         node = sequence;
     }
 
@@ -308,21 +301,16 @@ Ast::Node*EbnfParser::parseTerm()
     {
         if( sequence == 0 )
         {
-            sequence = new Ast::Node( Ast::Node::Sequence, d_def );
+            sequence = new( d_syn->getArena() ) Ast::Node( Ast::Node::Sequence, d_def );
             sequence->d_tok.d_lineNr = node->d_tok.d_lineNr;
             sequence->d_tok.d_colNr = node->d_tok.d_colNr;
-            sequence->d_subs.append(node);
-            node->d_parent = sequence;
+            sequence->append(d_syn->getArena(), node);
             node = sequence;
         }
         Ast::Node* n = parseFactor();
         if( n == 0 )
-        {
-            delete node;
             return 0;
-        }
-        sequence->d_subs.append(n);
-        n->d_parent = sequence;
+        sequence->append(d_syn->getArena(), n);
     }
     return node;
 }
@@ -332,7 +320,6 @@ bool EbnfParser::checkCardinality(Ast::Node* node)
     if( node->d_quant != Ast::Node::One )
     {
         error( d_cur, "contradicting nested quantifiers" );
-        delete node;
         return false;
     }
     if( node->d_type != Ast::Node::Sequence && node->d_type != Ast::Node::Alternative )
@@ -343,7 +330,6 @@ bool EbnfParser::checkCardinality(Ast::Node* node)
     if( node->d_subs.isEmpty() )
     {
         error( d_cur, "container with zero items" );
-        delete node;
         return false;
     }
     if( node->d_subs.size() == 1 &&
@@ -351,7 +337,6 @@ bool EbnfParser::checkCardinality(Ast::Node* node)
               || node->d_subs.first()->d_type == Ast::Node::Alternative))
     {
         error( d_cur, "container containing only one other sequence or alternative" );
-        delete node;
         return false;
     }
     return true;
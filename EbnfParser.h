@@ -23,6 +23,7 @@
 #include <QObject>
 #include <QStack>
 #include <QStringList>
+#include <QAtomicInt>
 #include "EbnfToken.h"
 #include "EbnfSyntax.h"
 
@@ -35,6 +36,7 @@ public:
     explicit EbnfParser(QObject *parent = 0);
 
     void setErrors( EbnfErrors* e ) { d_errs = e; }
+    void setCancel( const QAtomicInt* c ) { d_cancel = c; } // parse gives up at the next production if set
 
     bool parse( EbnfLexer* );
     EbnfSyntax* getSyntax();
@@ -57,6 +59,7 @@ private:
     Ast::Definition* d_def;
     EbnfToken d_cur;
     EbnfErrors* d_errs;
+    const QAtomicInt* d_cancel;
     EbnfSyntax::Defines d_defines;
     enum IfState { InIf, IfActive, InElse };
     QStack< QPair<quint8,bool> > d_ifState; // ifState, txOn
@@ -0,0 +1,306 @@
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "EbnfProfiler.h"
+#include <QTextStream>
+#include <QStringList>
+#include <QThreadStorage>
+#include <algorithm>
+
+QAtomicInt EbnfProfiler::s_enabled;
+QAtomicInt EbnfProfiler::s_allocs;
+EbnfProfiler::Entries EbnfProfiler::s_entries;
+QHash<QByteArray,int> EbnfProfiler::s_index;
+QMutex EbnfProfiler::s_lock;
+QList<const char*> EbnfProfiler::s_sites;
+QList<EbnfProfiler::ThreadCounts*> EbnfProfiler::s_threads;
+EbnfProfiler::SiteCounts EbnfProfiler::s_finished;
+
+// the site counters of one thread; registered while the thread lives, then kept in s_finished. Only the
+// thread itself resizes d_sites; s_lock is always taken before d_lock.
+struct EbnfProfiler::ThreadCounts
+{
+    QMutex d_lock;
+    SiteCounts d_sites;
+    ThreadCounts()
+    {
+        QMutexLocker lock(&s_lock);
+        s_threads.append(this);
+    }
+    ~ThreadCounts()
+    {
+        QMutexLocker lock(&s_lock);
+        s_threads.removeAll(this);
+        if( s_finished.size() < d_sites.size() )
+            s_finished.resize( d_sites.size() );
+        for( int i = 0; i < d_sites.size(); i++ )
+        {
+            s_finished[i].d_nsecs += d_sites[i].d_nsecs;
+            s_finished[i].d_calls += d_sites[i].d_calls;
+            s_finished[i].d_allocs += d_sites[i].d_allocs;
+        }
+    }
+};
+
+EbnfProfiler::Scope::Scope(const char* phase, const QByteArray& detail):
+    d_phase(phase),d_detail(detail),d_allocs(0),d_on(s_enabled.load())
+{
+    if( !d_on )
+        return;
+    d_allocs = s_allocs.load();
+    d_timer.start();
+}
+
+EbnfProfiler::Scope::~Scope()
+{
+    if( !d_on || !s_enabled.load() )
+        return;
+    QMutexLocker lock(&s_lock);
+    Entry& e = entry( d_phase, d_detail );
+    e.d_nsecs += d_timer.nsecsElapsed();
+    e.d_calls++;
+    e.d_allocs += quint32( s_allocs.load() ) - d_allocs;
+}
+
+EbnfProfiler::SiteScope::SiteScope(Site& site):d_site(site),d_allocs(0),d_on(s_enabled.load())
+{
+    if( !d_on )
+        return;
+    d_allocs = s_allocs.load();
+    d_timer.start();
+}
+
+EbnfProfiler::SiteScope::~SiteScope()
+{
+    if( !d_on || !s_enabled.load() )
+        return;
+    addSiteCount( d_site, d_timer.nsecsElapsed(), quint32( s_allocs.load() ) - d_allocs );
+}
+
+void EbnfProfiler::addSiteCount(Site& site, qint64 nsecs, quint32 allocs)
+{
+    int id = site.d_id.load();
+    if( id == 0 )
+    {
+        QMutexLocker lock(&s_lock);
+        id = site.d_id.load();
+        if( id == 0 )
+        {
+            s_sites.append( site.d_phase );
+            id = s_sites.size();
+            site.d_id.store( id );
+        }
+    }
+    static QThreadStorage<ThreadCounts*> s_threadCounts;
+    if( !s_threadCounts.hasLocalData() )
+        s_threadCounts.setLocalData( new ThreadCounts() );
+    ThreadCounts* t = s_threadCounts.localData();
+    // uncontended unless getEntries or reset run at the same time
+    QMutexLocker lock(&t->d_lock);
+    if( t->d_sites.size() < id )
+        t->d_sites.resize( id );
+    if( !t->d_sites[id - 1].d_listed )
+    {
+        // the phases are listed in order of first occurrence
+        lock.unlock();
+        QMutexLocker global(&s_lock);
+        lock.relock();
+        entry( site.d_phase, QByteArray() );
+        t->d_sites[id - 1].d_listed = true;
+    }
+    SiteCount& c = t->d_sites[id - 1];
+    c.d_nsecs += nsecs;
+    c.d_calls++;
+    c.d_allocs += allocs;
+}
+
+void EbnfProfiler::addSiteCounts(SiteCounts& counts, bool listed)
+{
+    for( int i = 0; i < counts.size(); i++ )
+    {
+        SiteCount& c = counts[i];
+        if( c.d_calls != 0 )
+        {
+            Entry& e = entry( s_sites[i], QByteArray() );
+            e.d_nsecs += c.d_nsecs;
+            e.d_calls += c.d_calls;
+            e.d_allocs += c.d_allocs;
+        }
+        c = SiteCount();
+        c.d_listed = listed;
+    }
+}
+
+EbnfProfiler::EbnfProfiler()
+{
+
+}
+
+void EbnfProfiler::reset()
+{
+    QMutexLocker lock(&s_lock);
+    s_entries.clear();
+    s_index.clear();
+    s_allocs.store(0);
+    foreach( ThreadCounts* t, s_threads )
+    {
+        QMutexLocker threadLock(&t->d_lock);
+        t->d_sites.fill( SiteCount() );
+    }
+    s_finished.clear();
+}
+
+void EbnfProfiler::addIterations(const char* phase, quint32 count, const QByteArray& detail)
+{
+    if( !s_enabled.load() )
+        return;
+    QMutexLocker lock(&s_lock);
+    entry( phase, detail ).d_iterations += count;
+}
+
+void EbnfProfiler::addTime(const char* phase, qint64 nsecs, const QByteArray& detail)
+{
+    if( !s_enabled.load() )
+        return;
+    QMutexLocker lock(&s_lock);
+    Entry& e = entry( phase, detail );
+    e.d_nsecs += nsecs;
+    e.d_calls++;
+}
+
+EbnfProfiler::Entry&EbnfProfiler::entry(const char* phase, const QByteArray& detail)
+{
+    QByteArray key = phase;
+    if( !detail.isEmpty() )
+        key += '\t' + detail;
+    QHash<QByteArray,int>::const_iterator i = s_index.find(key);
+    if( i != s_index.end() )
+        return s_entries[i.value()];
+    Entry e;
+    e.d_phase = phase;
+    e.d_detail = detail;
+    s_index.insert( key, s_entries.size() );
+    s_entries.append( e );
+    return s_entries.last();
+}
+
+static bool detailLessThan( const EbnfProfiler::Entry& lhs, const EbnfProfiler::Entry& rhs )
+{
+    return lhs.d_nsecs > rhs.d_nsecs;
+}
+
+EbnfProfiler::Entries EbnfProfiler::getEntries()
+{
+    QMutexLocker lock(&s_lock);
+    // the entries of the sites already exist
+    foreach( ThreadCounts* t, s_threads )
+    {
+        QMutexLocker threadLock(&t->d_lock);
+        addSiteCounts( t->d_sites, true );
+    }
+    addSiteCounts( s_finished, false );
+    Entries phases, details;
+    foreach( const Entry& e, s_entries )
+    {
+        if( e.d_detail.isEmpty() )
+            phases.append(e);
+        else
+            details.append(e);
+    }
+    std::stable_sort( details.begin(), details.end(), detailLessThan );
+    return phases + details;
+}
+
+static QString ms( qint64 nsecs )
+{
+    return QString::number( double(nsecs) / 1000000.0, 'f', 3 );
+}
+
+QString EbnfProfiler::toText(const Entries& l, int maxDetails)
+{
+    QString res;
+    QTextStream out(&res);
+    out << QString("%1 %2 %3 %4 %5").arg("phase",-32).arg("ms",12).arg("calls",10)
+           .arg("iterations",10).arg("allocs",10) << endl;
+    int details = 0;
+    foreach( const Entry& e, l )
+    {
+        if( !e.d_detail.isEmpty() )
+        {
+            details++;
+            continue;
+        }
+        out << QString("%1 %2 %3 %4 %5").arg(e.d_phase.constData(),-32).arg(ms(e.d_nsecs),12)
+               .arg(e.d_calls,10).arg(e.d_iterations,10).arg(e.d_allocs,10) << endl;
+    }
+    if( details > 0 )
+    {
+        out << endl << QString("top %1 of %2 details by time:").arg(qMin(details,maxDetails)).arg(details) << endl;
+        int n = 0;
+        foreach( const Entry& e, l )
+        {
+            if( e.d_detail.isEmpty() )
+                continue;
+            if( n++ >= maxDetails )
+                break;
+            const QString name = QString("%1 %2").arg(e.d_phase.constData()).arg(QString::fromUtf8(e.d_detail));
+            out << QString("%1 %2 %3 %4 %5").arg(name,-32).arg(ms(e.d_nsecs),12)
+                   .arg(e.d_calls,10).arg(e.d_iterations,10).arg(e.d_allocs,10) << endl;
+        }
+    }
+    out.flush();
+    return res;
+}
+
+static QString jsonName( const QByteArray& str )
+{
+    const QString s = QString::fromUtf8(str);
+    QString res;
+    res.reserve( s.size() + 2 );
+    res += '"';
+    for( int i = 0; i < s.size(); i++ )
+    {
+        const ushort ch = s[i].unicode();
+        if( ch == '\\' || ch == '"' )
+        {
+            res += '\\';
+            res += s[i];
+        }else if( ch < 0x20 )
+            res += QString("\\u%1").arg( ch, 4, 16, QChar('0') );
+        else
+            res += s[i];
+    }
+    res += '"';
+    return res;
+}
+
+QString EbnfProfiler::toJson(const Entries& l, int indent)
+{
+    const QString ws( indent, QChar(' ') );
+    QStringList items;
+    foreach( const Entry& e, l )
+    {
+        items << QString("%1  { \"phase\": %2, \"detail\": %3, \"ms\": %4, \"calls\": %5, \"iterations\": %6, \"allocs\": %7 }")
+                 .arg(ws).arg(jsonName(e.d_phase)).arg(jsonName(e.d_detail)).arg(ms(e.d_nsecs))
+                 .arg(e.d_calls).arg(e.d_iterations).arg(e.d_allocs);
+    }
+    if( items.isEmpty() )
+        return "[]";
+    return "[\n" + items.join(",\n") + "\n" + ws + "]";
+}
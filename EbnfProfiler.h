@@ -0,0 +1,125 @@
+#ifndef EBNFPROFILER_H
+#define EBNFPROFILER_H
+
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QVector>
+
+// Records wall time, call, iteration and allocation counts per phase of the analysis pipeline.
+// Disabled by default; when disabled a Scope or SiteScope costs a single flag test. Entries can be added
+// from worker threads while they are read or reset.
+class EbnfProfiler
+{
+public:
+    struct Entry
+    {
+        QByteArray d_phase;
+        QByteArray d_detail; // e.g. the name of the Definition; empty for the whole phase
+        qint64 d_nsecs;
+        quint32 d_calls;
+        quint32 d_iterations; // e.g. rounds of a fixed-point loop
+        quint32 d_allocs; // Ast objects allocated during the phase
+        Entry():d_nsecs(0),d_calls(0),d_iterations(0),d_allocs(0){}
+    };
+    typedef QList<Entry> Entries;
+
+    class Scope
+    {
+    public:
+        Scope( const char* phase, const QByteArray& detail = QByteArray() );
+        ~Scope();
+    private:
+        QElapsedTimer d_timer;
+        const char* d_phase;
+        QByteArray d_detail;
+        quint32 d_allocs;
+        bool d_on;
+    };
+
+    // A call site entered too often for a Scope, e.g. once per token; declare it static. The calls are summed
+    // up in counters of the calling thread under a lock of their own and added to the entry of the phase by
+    // getEntries.
+    class Site
+    {
+    public:
+        Site( const char* phase ):d_phase(phase){}
+    private:
+        friend class EbnfProfiler;
+        const char* d_phase;
+        QAtomicInt d_id; // 0 until first entered, then the index in the counters of each thread plus one
+    };
+
+    class SiteScope
+    {
+    public:
+        SiteScope( Site& );
+        ~SiteScope();
+    private:
+        QElapsedTimer d_timer;
+        Site& d_site;
+        quint32 d_allocs;
+        bool d_on;
+    };
+
+    static void setEnabled( bool on ) { s_enabled.store(on); }
+    static bool isEnabled() { return s_enabled.load(); }
+    static void reset();
+
+    static void addIterations( const char* phase, quint32 count = 1, const QByteArray& detail = QByteArray() );
+    // adds a call measured elsewhere, e.g. the whole run of a worker thread
+    static void addTime( const char* phase, qint64 nsecs, const QByteArray& detail = QByteArray() );
+    static void countAlloc() { if( s_enabled.load() ) s_allocs.fetchAndAddRelaxed(1); }
+
+    static Entries getEntries(); // phases in order of first occurrence, details sorted by descending time
+    static QString toText( const Entries&, int maxDetails = 20 );
+    static QString toJson( const Entries&, int indent = 0 );
+private:
+    EbnfProfiler();
+    static Entry& entry( const char* phase, const QByteArray& detail );
+    struct SiteCount
+    {
+        qint64 d_nsecs;
+        quint32 d_calls;
+        quint32 d_allocs;
+        bool d_listed; // the entry of the phase exists
+        SiteCount():d_nsecs(0),d_calls(0),d_allocs(0),d_listed(false){}
+    };
+    typedef QVector<SiteCount> SiteCounts; // by Site::d_id - 1
+    struct ThreadCounts;
+    static void addSiteCount( Site&, qint64 nsecs, quint32 allocs );
+    static void addSiteCounts( SiteCounts&, bool listed );
+    static QAtomicInt s_enabled;
+    static QAtomicInt s_allocs;
+    static Entries s_entries;
+    static QHash<QByteArray,int> s_index;
+    static QMutex s_lock;
+    static QList<const char*> s_sites; // the phases by Site::d_id - 1
+    static QList<ThreadCounts*> s_threads;
+    static SiteCounts s_finished; // of the threads which ended since the last getEntries
+};
+
+#endif // EBNFPROFILER_H
@@ -33,6 +33,7 @@ QMAKE_CXXFLAGS += -Wno-reorder -Wno-unused-parameter -Wno-unused-function -Wno-u
 SOURCES += main.cpp\
         MainWindow.cpp \
     EbnfEditor.cpp \
+    EbnfParseJob.cpp \
     EbnfHighlighter.cpp \
     EbnfLexer.cpp \
     EbnfToken.cpp \
@@ -46,15 +47,20 @@ SOURCES += main.cpp\
     GenUtils.cpp \
     CocoGen.cpp \
     FirstFollowSet.cpp \
+    FlatSyntax.cpp \
+    LlkDfa.cpp \
+    SyntaxDelta.cpp \
     AntlrGen.cpp \
     LlgenGen.cpp \
     ../GuiTools/CodeEditor.cpp \
     SyntaxTools.cpp \
     LaParser.cpp \
-    CppGen.cpp
+    CppGen.cpp \
+    EbnfProfiler.cpp
 
 HEADERS  += MainWindow.h \
     EbnfEditor.h \
+    EbnfParseJob.h \
     EbnfHighlighter.h \
     EbnfLexer.h \
     EbnfToken.h \
@@ -68,12 +74,16 @@ HEADERS  += MainWindow.h \
     GenUtils.h \
     CocoGen.h \
     FirstFollowSet.h \
+    FlatSyntax.h \
+    LlkDfa.h \
+    SyntaxDelta.h \
     AntlrGen.h \
     LlgenGen.h \
     ../GuiTools/CodeEditor.h \
     SyntaxTools.h \
     LaParser.h \
-    CppGen.h
+    CppGen.h \
+    EbnfProfiler.h
 
 INCLUDEPATH += ..
 
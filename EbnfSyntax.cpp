@@ -20,11 +20,21 @@
 #include "EbnfSyntax.h"
 #include "EbnfErrors.h"
 #include "LaParser.h"
+#include "SyntaxDelta.h"
 #include <QTextStream>
+#include <QScopedPointer>
 #include <QtDebug>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 
 // Ursprünglich aus Ada::Syntax adaptiert; stark modifiziert
 
+// the nodes are the bulk of the arena (see the B/node column of EbnfBench); the symbol, one word for the
+// type, quantifier, flags and position, the id, the subs and three pointers
+Q_STATIC_ASSERT( sizeof(Ast::Node) == sizeof(Ast::Symbol) + 2 * sizeof(quint32) + sizeof(Ast::NodeArray) +
+                 3 * sizeof(void*) );
+
 const char* Ast::Node::s_typeName[] =
 {
     "Terminal",
@@ -89,14 +99,15 @@ Ast::NodeSet EbnfSyntax::collectNodes(const Ast::NodeRefSet& pattern, const Ast:
     return res;
 }
 
-EbnfSyntax::EbnfSyntax(EbnfErrors* errs):d_finished(false),d_errs(errs)
+EbnfSyntax::EbnfSyntax(EbnfErrors* errs):d_finished(false),d_errs(errs),d_termCount(0),d_recomputed(0)
 {
-
+    d_symGen = EbnfToken::acquireSymGeneration();
 }
 
 EbnfSyntax::~EbnfSyntax()
 {
     clear();
+    EbnfToken::releaseSymGeneration(d_symGen);
 }
 
 void EbnfSyntax::dump() const
@@ -118,6 +129,14 @@ void EbnfSyntax::clear()
     d_pragmas.clear();
     d_finished = false;
     d_idol.clear();
+    d_symIds.clear();
+    d_idSyms.clear();
+    d_termCount = 0;
+    d_symsByPos.clear();
+    d_flat.clear();
+    d_leftRec.clear();
+    d_pathToDef.clear();
+    d_recomputed = 0;
 }
 
 static bool isTerminalOrSeqOfTerminals( const Ast::Node* n )
@@ -176,12 +195,11 @@ bool EbnfSyntax::addPragma(const EbnfToken& name, Ast::Node* ex)
         if( d_errs )
             d_errs->warning( EbnfErrors::Semantics, name.d_lineNr, name.d_colNr,
                            QObject::tr("invalid pragma '%1'").arg(name.d_val.toStr()) );
-        delete ex;
         return false;
     }
     Ast::Definition*& def = d_pragmas[ name.d_val ];
     if( def == 0 )
-        def = new Ast::Definition(name);
+        def = new( d_arena ) Ast::Definition(name);
 
     if( def->d_node == 0 )
     {
@@ -191,24 +209,20 @@ bool EbnfSyntax::addPragma(const EbnfToken& name, Ast::Node* ex)
     if( def->d_node->d_type != Ast::Node::Sequence )
     {
         Ast::Node* n = def->d_node;
-        def->d_node = new Ast::Node( Ast::Node::Sequence, def );
-        def->d_node->d_subs.append(n);
-        n->d_parent = def->d_node;
+        def->d_node = new( d_arena ) Ast::Node( Ast::Node::Sequence, def );
+        def->d_node->append(d_arena, n);
     }
     if( ex->d_type == Ast::Node::Sequence )
     {
-        def->d_node->d_subs += ex->d_subs;
         foreach( Ast::Node* n, ex->d_subs )
         {
-            n->d_parent = def->d_node;
+            def->d_node->append(d_arena, n);
             n->d_owner = def;
         }
         ex->d_subs.clear();
-        delete ex;
     }else
     {
-        def->d_node->d_subs.append(ex);
-        ex->d_parent = def->d_node;
+        def->d_node->append(d_arena, ex);
         ex->d_owner = def;
     }
     return true;
@@ -250,17 +264,67 @@ void EbnfSyntax::addIdol(qint32 line)
     d_idol.append(line);
 }
 
-bool EbnfSyntax::finishSyntax()
+bool EbnfSyntax::finishSyntax(const EbnfSyntax* prev)
 {
     if( d_finished )
         return true;
-    if( !resolveAllSymbols() )
-        return false;
-    checkReachability();
-    calculateNullable();
-    calcLeftRecursion();
+    EbnfProfiler::Scope total("finishSyntax");
+    {
+        EbnfProfiler::Scope prof("indexSymbolPositions");
+        indexSymbolPositions();
+    }
+    {
+        EbnfProfiler::Scope prof("resolveAllSymbols");
+        const bool ok = resolveAllSymbols();
+        initNodeFlags(); // the nodes of an unfinished syntax are still shown
+        if( !ok )
+            return false;
+    }
+    {
+        EbnfProfiler::Scope prof("checkReachability");
+        checkReachability();
+    }
+    {
+        // the terminals only used by productions not reachable are not numbered
+        EbnfProfiler::Scope prof("numberSymbols");
+        numberSymbols();
+    }
+    QScopedPointer<SyntaxDelta> delta;
+    if( prev != 0 && prev != this && prev->d_finished )
+    {
+        EbnfProfiler::Scope prof("diffSyntax");
+        delta.reset( new SyntaxDelta( prev, this ) );
+        // the flat syntax starts with the flags of the definitions
+        for( quint32 d = 0; d < delta->getDefCount(); d++ )
+        {
+            if( const Ast::Definition* old = delta->getPrev(d) )
+            {
+                d_order[d]->d_nullable = old->d_nullable;
+                d_order[d]->d_repeatable = old->d_repeatable;
+            }
+        }
+    }
+    {
+        EbnfProfiler::Scope prof("flattenSyntax");
+        d_flat.build(this);
+    }
+    QBitArray recomputed( d_order.size(), delta.isNull() );
+    {
+        EbnfProfiler::Scope prof("calculateNullable");
+        calculateNullable( delta.data(), recomputed );
+    }
+    {
+        EbnfProfiler::Scope prof("calcLeftRecursion");
+        calcLeftRecursion( delta.data(), recomputed );
+    }
+    d_recomputed = recomputed.count(true);
+    if( delta )
+        EbnfProfiler::addIterations( "diffSyntax", d_recomputed );
     checkPragmas();
-    checkPredicates();
+    {
+        EbnfProfiler::Scope prof("checkPredicates");
+        checkPredicates();
+    }
     d_finished = true;
     return true;
 }
@@ -275,13 +339,18 @@ bool EbnfSyntax::resolveAllSymbols()
         (*i)->d_usedBy.clear();
 	}
     d_backRefs.clear();
-    for( i = d_order.begin(); i != d_order.end(); ++i )
+    // the position in d_order by EbnfToken::Sym::getId() for the references collected in d_refs
+    QVector<quint32> index( EbnfToken::getSymCount(), FlatSyntax::Invalid );
+    for( int j = 0; j < d_order.size(); j++ )
+        index[ d_order[j]->d_tok.d_val.getId() ] = j;
+    d_refs = FlatSyntax::Graph( d_order.size() );
+    for( int j = 0; j < d_order.size(); j++ )
     {
-        Ast::Definition* d = (*i);
+        Ast::Definition* d = d_order[j];
         if( d->d_node && !d->doIgnore() )
         {
             //qDebug() << Node::s_typeName[(*i)->d_node->d_type] << (*i)->d_node->d_tok.toString(false);
-            resolveAllSymbols( d->d_node );
+            resolveAllSymbols( d->d_node, index, d_refs[j] );
         }
 	}
     for( int j = 1; j < d_order.size(); j++ ) // ignore first
@@ -301,36 +370,66 @@ bool EbnfSyntax::resolveAllSymbols()
         return true;
 }
 
-void EbnfSyntax::calculateNullable()
+void EbnfSyntax::initNodeFlags()
 {
-    // Implement algorithm by a fixed­‐point iteration
-
+    // Reachability and nullability are not known yet; checkReachability and calculateNullable update the flags
     foreach( Ast::Definition* d, d_order )
     {
-        d->d_nullable = false;
-        d->d_repeatable = false;
+        if( d->d_node )
+            initNodeFlags( d->d_node );
     }
+    foreach( Ast::Definition* d, d_pragmas )
+    {
+        if( d->d_node )
+            initNodeFlags( d->d_node );
+    }
+}
 
-    bool changed;
-    do
+void EbnfSyntax::initNodeFlags(Ast::Node* node)
+{
+    foreach( Ast::Node* sub, node->d_subs )
+        initNodeFlags( sub );
+    node->d_flags = ( node->d_flags & ~Ast::Node::Cached ) | node->calcFlags();
+}
+
+void EbnfSyntax::calculateNullable(const SyntaxDelta* delta, QBitArray& recomputed)
+{
+    if( delta == 0 )
     {
-        changed = false;
-        foreach( Ast::Definition* d, d_order )
+        d_flat.calculateNullable();
+        return;
+    }
+    // The components of the definitions using each other are evaluated callees first; a component is only
+    // evaluated again if one of its definitions changed or uses one whose flags differ from before.
+    const FlatSyntax::Graph& users = delta->getUsers();
+    const FlatSyntax::Components comps = FlatSyntax::findComponents( users );
+    QBitArray dirty = delta->getChanged();
+    for( int c = comps.size() - 1; c >= 0; c-- )
+    {
+        bool any = false;
+        foreach( quint32 d, comps[c] )
+            any |= dirty.testBit(d);
+        if( !any )
+            continue;
+        d_flat.calculateNullable( comps[c] );
+        foreach( quint32 d, comps[c] )
         {
-            const bool nullable = ( d->d_node == 0 ? false : d->d_node->isNullable() );
-            const bool repeatable = ( d->d_node == 0 ? false : d->d_node->isRepeatable() );
-            if( nullable != d->d_nullable || repeatable != d->d_repeatable )
+            recomputed.setBit(d);
+            const Ast::Definition* old = delta->getPrev(d);
+            if( old == 0 || old->d_nullable != d_order[d]->d_nullable ||
+                    old->d_repeatable != d_order[d]->d_repeatable )
             {
-                d->d_nullable = nullable;
-                d->d_repeatable = repeatable;
-                changed = true;
+                foreach( quint32 user, users[d] )
+                    dirty.setBit(user);
             }
         }
-    }while( changed );
-
-    // The computation will terminate because
-    // - the variables are only changed monotonically (from false to true)
-    // - the number of possible changes is finite (from all false to all true)
+    }
+    // the nodes of the others keep the flags of the earlier version
+    for( int d = 0; d < d_order.size(); d++ )
+    {
+        if( !recomputed.testBit(d) )
+            d_flat.storeFlags(d);
+    }
 
 #if 0
     // Vergleich mit Coco/R gibt gleiches Resultat
@@ -344,36 +443,30 @@ void EbnfSyntax::calculateNullable()
 
 void EbnfSyntax::checkReachability()
 {
-    bool changed;
-    do
+    // The first production is the start; the unused productions are already reported and still analyzed,
+    // so they are roots as well. The others are reachable if a reachable production uses them.
+    QBitArray roots( d_order.size() );
+    for( int j = 0; j < d_order.size(); j++ )
     {
-        changed = false;
-        foreach( Ast::Definition* d, d_order )
-        {
-            if( d->d_usedBy.isEmpty() || d->doIgnore() )
-                continue; // unused already checked
-
-            bool atLeastOneIsReachable = false;
-            foreach( const Ast::Node* n, d->d_usedBy )
-            {
-                if( !n->doIgnore() && !n->d_owner->doIgnore() )
-                {
-                    atLeastOneIsReachable = true;
-                    break;
-                }
-            }
-            const bool notReachable = !atLeastOneIsReachable;
-            // qDebug() << d->d_tok.d_val.c_str() << atLeastOneIsReachable << d->doIgnore() << d->d_notReachable;
-            if( notReachable != d->d_notReachable )
-            {
-                if( d_errs )
-                    d_errs->warning( EbnfErrors::Semantics, d->d_tok.d_lineNr, d->d_tok.d_colNr,
-                                     QObject::tr("production not reachable '%1'").arg(d->d_tok.d_val.c_str() ));
-                changed = true;
-                d->d_notReachable = notReachable;
-            }
-        }
-    }while( changed );
+        const Ast::Definition* d = d_order[j];
+        if( !d->doIgnore() && ( j == 0 || d->d_usedBy.isEmpty() ) )
+            roots.setBit(j);
+    }
+    const QBitArray reached = FlatSyntax::reachable( d_refs, roots );
+    EbnfProfiler::addIterations( "checkReachability", reached.count(true) );
+    for( int j = 0; j < d_order.size(); j++ )
+    {
+        Ast::Definition* d = d_order[j];
+        if( reached.testBit(j) || d->doIgnore() )
+            continue;
+        if( d_errs )
+            d_errs->warning( EbnfErrors::Semantics, d->d_tok.d_lineNr, d->d_tok.d_colNr,
+                             QObject::tr("production not reachable '%1'").arg(d->d_tok.d_val.c_str() ));
+        d->d_notReachable = true;
+        // only the ignore flag of the uses depends on the definition being reachable
+        foreach( Ast::Node* n, d->d_usedBy )
+            n->d_flags = ( n->d_flags & ~Ast::Node::Ignored ) | ( n->calcFlags() & Ast::Node::Ignored );
+    }
     foreach( Ast::Definition* d, d_order )
     {
         if( d->doIgnore() )
@@ -391,21 +484,53 @@ static inline bool isHit( const Ast::Symbol* sym, quint32 line, quint16 col )
             sym->d_tok.d_colNr <= col && col <= ( sym->d_tok.d_colNr + sym->d_tok.d_len );
 }
 
+static inline bool posLessThan( quint32 line, quint16 col, const Ast::Symbol* sym )
+{
+    return line < sym->d_tok.d_lineNr || ( line == sym->d_tok.d_lineNr && col < sym->d_tok.d_colNr );
+}
+
 const Ast::Symbol*EbnfSyntax::findSymbolBySourcePos(quint32 line, quint16 col, bool nonTermOnly) const
 {
     //qDebug() << "find" << line << col;
-    for( int i = d_order.size() - 1; i >= 0; i-- )
+    // the symbols don't overlap, but one can end where the next one starts, in which case the first one wins
+    int hi = d_symsByPos.size();
+    int lo = 0;
+    while( lo < hi )
     {
-        if( d_order[i]->d_tok.d_lineNr <= line )
-        {
+        const int mid = ( lo + hi ) / 2;
+        if( posLessThan( line, col, d_symsByPos[mid].d_sym ) )
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    const Ast::Symbol* res = 0;
+    for( int i = lo - 1; i >= 0 && isHit( d_symsByPos[i].d_sym, line, col ); i-- )
+    {
+        if( d_symsByPos[i].d_nonTerm || !nonTermOnly )
+            res = d_symsByPos[i].d_sym;
+    }
+    return res;
+}
 
-            if( !nonTermOnly && isHit( d_order[i], line, col ) )
-                return d_order[i];
-            else
-                return findSymbolBySourcePosImp( d_order[i]->d_node, line, col, nonTermOnly );
-        }
+EbnfSyntax::ConstSymList EbnfSyntax::findSymbolsInLines(quint32 fromLine, quint32 toLine, bool nonTermOnly) const
+{
+    int hi = d_symsByPos.size();
+    int lo = 0;
+    while( lo < hi )
+    {
+        const int mid = ( lo + hi ) / 2;
+        if( d_symsByPos[mid].d_sym->d_tok.d_lineNr >= fromLine )
+            hi = mid;
+        else
+            lo = mid + 1;
     }
-    return 0;
+    ConstSymList res;
+    for( int i = lo; i < d_symsByPos.size() && d_symsByPos[i].d_sym->d_tok.d_lineNr <= toLine; i++ )
+    {
+        if( d_symsByPos[i].d_nonTerm || !nonTermOnly )
+            res.append( d_symsByPos[i].d_sym );
+    }
+    return res;
 }
 
 Ast::ConstNodeList EbnfSyntax::getBackRefs(const Ast::Symbol* sym) const
@@ -468,7 +593,7 @@ const Ast::Node*EbnfSyntax::firstPredicateOf(const Ast::Node* node)
     return 0;
 }
 
-bool EbnfSyntax::resolveAllSymbols(Ast::Node *node)
+bool EbnfSyntax::resolveAllSymbols(Ast::Node *node, const QVector<quint32>& index, QVector<quint32>& refs)
 {
 	Q_ASSERT( node->d_owner != 0 );
     switch( node->d_type )
@@ -481,6 +606,8 @@ bool EbnfSyntax::resolveAllSymbols(Ast::Node *node)
                 Ast::Definition* def = i.value();
                 def->d_usedBy.insert(node);
                 node->d_def = def;
+                if( node->d_tok.d_op != EbnfToken::Skip )
+                    refs.append( index[ def->d_tok.d_val.getId() ] );
                 d_backRefs[node->d_tok.d_val].append(node);
                 if( def->doIgnore() )
                     error( d_errs, EbnfErrors::Semantics, node->d_tok,
@@ -503,7 +630,7 @@ bool EbnfSyntax::resolveAllSymbols(Ast::Node *node)
     }
     foreach( Ast::Node* sub, node->d_subs )
     {
-        resolveAllSymbols( sub );
+        resolveAllSymbols( sub, index, refs );
     }
     if( d_errs )
         return d_errs->getErrCount() == 0;
@@ -511,38 +638,221 @@ bool EbnfSyntax::resolveAllSymbols(Ast::Node *node)
         return true;
 }
 
-const Ast::Symbol*EbnfSyntax::findSymbolBySourcePosImp(const Ast::Node* node, quint32 line, quint16 col, bool nonTermOnly) const
+void EbnfSyntax::numberSymbols()
+{
+    d_symIds.fill( InvalidId, EbnfToken::getSymCount() );
+    d_idSyms.clear();
+    // terminals first in the order of their first occurrence, then the nonterminal productions
+    foreach( const Ast::Definition* d, d_order )
+    {
+        if( d->d_node == 0 )
+            numberSymbol( d->d_tok.d_val );
+        else if( !d->doIgnore() )
+            numberTerminals( d->d_node );
+    }
+    d_termCount = d_idSyms.size();
+    foreach( const Ast::Definition* d, d_order )
+    {
+        if( d->d_node != 0 )
+            numberSymbol( d->d_tok.d_val );
+    }
+}
+
+void EbnfSyntax::numberTerminals(const Ast::Node* node)
+{
+    switch( node->d_type )
+    {
+    case Ast::Node::Terminal:
+        numberSymbol( node->d_tok.d_val );
+        break;
+    case Ast::Node::Nonterminal:
+        if( node->d_def == 0 || node->d_def->d_node == 0 )
+            numberSymbol( node->d_tok.d_val ); // unechtes Terminal
+        break;
+    default:
+        break;
+    }
+    foreach( const Ast::Node* sub, node->d_subs )
+        numberTerminals( sub );
+}
+
+quint32 EbnfSyntax::numberSymbol(const EbnfToken::Sym& sym)
+{
+    const quint32 i = sym.getId();
+    Q_ASSERT( i < quint32(d_symIds.size()) );
+    if( d_symIds[i] == InvalidId )
+    {
+        d_symIds[i] = d_idSyms.size();
+        d_idSyms.append( sym );
+    }
+    return d_symIds[i];
+}
+
+bool EbnfSyntax::symbolPosLessThan( const SymbolPos& lhs, const SymbolPos& rhs )
+{
+    return posLessThan( lhs.d_sym->d_tok.d_lineNr, lhs.d_sym->d_tok.d_colNr, rhs.d_sym );
+}
+
+void EbnfSyntax::indexSymbolPositions()
+{
+    d_symsByPos.clear();
+    foreach( const Ast::Definition* d, d_order )
+    {
+        SymbolPos p;
+        p.d_sym = d;
+        p.d_nonTerm = false;
+        d_symsByPos.append( p );
+        indexSymbolPositions( d->d_node );
+    }
+    // the definitions and their nodes are mostly in source order already
+    std::stable_sort( d_symsByPos.begin(), d_symsByPos.end(), symbolPosLessThan );
+}
+
+void EbnfSyntax::indexSymbolPositions(const Ast::Node* node)
 {
     if( node == 0 )
-        return 0;
-    if( node->d_tok.d_lineNr > line )
-        return 0;
-    //qDebug() << "Node" << node->d_tok.toString() << node->d_tok.d_lineNr << node->d_tok.d_colNr << node->d_tok.d_len;
-    if( node->d_type == Ast::Node::Terminal && !nonTermOnly && isHit( node, line, col ) )
-        return node;
-    else if( node->d_type == Ast::Node::Nonterminal && isHit( node, line, col ) )
-        return node;
-    // else
-    foreach( const Ast::Node* n, node->d_subs )
+        return;
+    if( node->d_type == Ast::Node::Terminal || node->d_type == Ast::Node::Nonterminal )
     {
-        // TODO: binary search falls nötig
-        const Ast::Symbol* res = findSymbolBySourcePosImp( n, line, col, nonTermOnly );
-        if( res )
-            return res;
+        SymbolPos p;
+        p.d_sym = node;
+        p.d_nonTerm = node->d_type == Ast::Node::Nonterminal;
+        d_symsByPos.append( p );
     }
-    return 0;
+    foreach( const Ast::Node* n, node->d_subs )
+        indexSymbolPositions( n );
 }
 
-void EbnfSyntax::calcLeftRecursion()
+void EbnfSyntax::calcLeftRecursion(const SyntaxDelta* delta, QBitArray& recomputed)
 {
-    foreach( Ast::Definition* d, d_order )
+    // A nonterminal a definition can start with closes a left recursion if it refers to a definition of the
+    // same strongly connected component of the graph of these nonterminals; this is the case for exactly the
+    // nonterminals a search along all paths from the referenced definition would find.
+    const quint32 count = d_order.size();
+    QHash<const Ast::Definition*,quint32> index;
+    index.reserve( count );
+    for( quint32 i = 0; i < count; i++ )
+        index.insert( d_order[i], i );
+    QVector<Ast::NodeList> uses( count );
+    FlatSyntax::Graph graph( count );
+    for( quint32 i = 0; i < count; i++ )
+    {
+        collectStartUses( d_order[i]->d_node, uses[i] );
+        for( int j = 0; j < uses[i].size(); j++ )
+        {
+            const quint32 to = index.value( uses[i][j]->d_def, FlatSyntax::Invalid );
+            if( to == FlatSyntax::Invalid )
+                uses[i].removeAt( j-- );
+            else if( !graph[i].contains( to ) )
+                graph[i].append( to );
+        }
+    }
+    const FlatSyntax::Components comps = FlatSyntax::findComponents( graph );
+    QVector<quint32> compOf( count );
+    for( int c = 0; c < comps.size(); c++ )
     {
+        foreach( quint32 d, comps[c] )
+            compOf[d] = c;
+    }
+    QVector<Ast::NodeList> cycles( count ); // by referenced definition, the nonterminals closing a recursion
+    for( quint32 i = 0; i < count; i++ )
+    {
+        foreach( Ast::Node* use, uses[i] )
+        {
+            const quint32 to = index.value( use->d_def );
+            if( compOf[to] == compOf[i] )
+                cycles[to].append( use );
+        }
+    }
+
+    // Unless one of the definitions a definition can start with changed or differs in being nullable, the
+    // recursions are the ones of the previous version and are replayed from there in the same order.
+    QBitArray redo;
+    if( delta )
+    {
+        QBitArray seeds = delta->getChanged();
+        for( quint32 d = 0; d < delta->getDefCount(); d++ )
+        {
+            const Ast::Definition* old = delta->getPrev(d);
+            if( old != 0 && old->d_nullable != d_order[d]->d_nullable )
+                seeds.setBit(d);
+        }
+        redo = FlatSyntax::reachable( FlatSyntax::transpose( graph ), seeds );
+    }
+
+    // The path of a recursion leads from the referenced definition to the root of the component and from
+    // there to the definition of the nonterminal, along two trees computed once per component; the cycles on
+    // the way are cut out.
+    QVector<Ast::Node*> toRoot( count ); // the nonterminal leading one step closer to the root
+    QVector<Ast::Node*> fromRoot( count ); // the nonterminal by which the definition is reached from the root
+    QBitArray treesDone( comps.size() );
+    QVector<int> pathPos( count, -1 );
+    for( quint32 i = 0; i < count; i++ )
+    {
+        Ast::Definition* d = d_order[i];
         d->d_directLeftRecursive = false;
         d->d_indirectLeftRecursive = false;
         if( d->doIgnore() || d->d_node == 0 )
             continue;
-        Ast::NodeList path;
-        markLeftRecursion(d,d->d_node,path);
+        if( delta && !redo.testBit(i) && copyLeftRecursion( d, delta->getPrev(i), *delta ) )
+            continue;
+        recomputed.setBit(i);
+        if( cycles[i].isEmpty() )
+            continue;
+        const quint32 c = compOf[i];
+        if( !treesDone.testBit(c) )
+        {
+            calcRecursionTrees( comps[c], index, uses, cycles, toRoot, fromRoot );
+            treesDone.setBit(c);
+        }
+        const quint32 root = comps[c].first();
+        foreach( Ast::Node* use, cycles[i] )
+        {
+            Ast::NodeList steps;
+            for( quint32 x = i; x != root; x = index.value( toRoot[x]->d_def ) )
+                steps.append( toRoot[x] );
+            Ast::NodeList down;
+            for( quint32 x = index.value( use->d_owner ); x != root; x = index.value( fromRoot[x]->d_owner ) )
+                down.prepend( fromRoot[x] );
+            steps += down;
+
+            LeftRecursion rec;
+            rec.d_use = use;
+            rec.d_direct = use->d_owner == d;
+            QVector<quint32> defs; // defs[k] is where rec.d_path[k] is
+            defs.append( i );
+            pathPos[i] = 0;
+            foreach( Ast::Node* step, steps )
+            {
+                const quint32 to = index.value( step->d_def );
+                if( pathPos[to] != -1 )
+                {
+                    while( defs.size() > pathPos[to] + 1 )
+                    {
+                        pathPos[defs.back()] = -1;
+                        defs.pop_back();
+                        rec.d_path.pop_back();
+                    }
+                }else
+                {
+                    rec.d_path.append( step );
+                    pathPos[to] = defs.size();
+                    defs.append( to );
+                }
+            }
+            foreach( quint32 x, defs )
+                pathPos[x] = -1;
+
+            if( rec.d_direct )
+                d->d_directLeftRecursive = true;
+            else
+                d->d_indirectLeftRecursive = true;
+            use->d_flags |= Ast::Node::LeftRecursive;
+            Q_ASSERT( use->d_id != FlatSyntax::Invalid ); // numbered by flattenSyntax
+            d_pathToDef.insert( use->d_id, rec.d_path );
+            d_leftRec[d].append(rec);
+            reportLeftRecursion(d,rec);
+        }
     }
     /*
     QList< QPair<Node,NodeSet> > startsWith;
@@ -555,7 +865,7 @@ void EbnfSyntax::calcLeftRecursion()
         NodeSet::iterator i = startsWith.last().second.find(&startsWith.last().first);
         if( i != startsWith.last().second.end() )
         {
-            const_cast<Node*>((*i).d_node)->d_leftRecursive = true;
+            const_cast<Node*>((*i).d_node)->d_flags |= Node::LeftRecursive;
             startsWith.last().first.d_owner->d_directLeftRecursive = true;
             qDebug() << "direct left recursion" << startsWith.last().first.d_owner->d_tok.d_val;
             startsWith.last().second.erase(i);
@@ -584,78 +894,29 @@ void EbnfSyntax::calcLeftRecursion()
 
 }
 
-void EbnfSyntax::markLeftRecursion(Ast::Definition* start, Ast::Node* cur, Ast::NodeList& path)
+void EbnfSyntax::collectStartUses(Ast::Node* cur, Ast::NodeList& uses)
 {
+    // the elements of an alternative and the ones of a sequence up to and including the first one which is
+    // not nullable, in source order
     if( cur == 0 || cur->doIgnore() )
         return;
 
-    if( cur->d_owner == start )
-    {
-        cur->d_pathToDef.clear();
-        cur->d_leftRecursive = false;
-    }
     switch( cur->d_type )
     {
     case Ast::Node::Alternative:
-        foreach( Ast::Node* sub, cur->d_subs )
-        {
-            if( sub->doIgnore() )
-                continue;
-            markLeftRecursion(start,sub,path);
-        }
-        break;
     case Ast::Node::Sequence:
         foreach( Ast::Node* sub, cur->d_subs )
         {
             if( sub->doIgnore() )
                 continue;
-            // gehe bis zum ersten das nicht optional ist; diese alle sind potentielle Starts
-            markLeftRecursion(start,sub,path);
-            if( !sub->isNullable() )
+            collectStartUses(sub,uses);
+            if( cur->d_type == Ast::Node::Sequence && !sub->isNullable() )
                 break;
         }
         break;
     case Ast::Node::Nonterminal:
-        if( !cur->doIgnore() && cur->d_def != 0 && cur->d_def->d_node != 0 )
-        {
-            if( cur->d_def == start )
-            {
-                if( cur->d_owner == start )
-                    start->d_directLeftRecursive = true;
-                else
-                    start->d_indirectLeftRecursive = true;
-                cur->d_leftRecursive = true;
-                cur->d_pathToDef = path;
-                if( d_errs )
-                {
-                    Ast::ConstNodeList l;
-                    foreach( Ast::Node* n, path )
-                        l.append(n);
-                    d_errs->error( EbnfErrors::Semantics, cur->d_tok.d_lineNr, cur->d_tok.d_colNr,
-                                   QString("%1 left recursion with '%2'").
-                                   arg(start->d_directLeftRecursive?"direct":"indirect").arg(start->d_tok.d_val.toStr()),
-                                   QVariant::fromValue(EbnfSyntax::IssueData(
-                                                           EbnfSyntax::IssueData::LeftRec,start->d_node, cur,l)));
-                }
-            }else
-            {
-                bool recursion = false;
-                foreach( Ast::Node* n, path )
-                {
-                    if( n == cur || n->d_def == cur->d_def )
-                    {
-                        recursion = true;
-                        break;
-                    }
-                }
-                if( !recursion )
-                {
-                    path.push_back(cur);
-                    markLeftRecursion(start,cur->d_def->d_node,path);
-                    path.pop_back();
-                }
-            }
-        }
+        if( cur->d_def != 0 && cur->d_def->d_node != 0 )
+            uses.append(cur);
         break;
     case Ast::Node::Terminal:
     case Ast::Node::Predicate:
@@ -664,6 +925,87 @@ void EbnfSyntax::markLeftRecursion(Ast::Definition* start, Ast::Node* cur, Ast::
     }
 }
 
+void EbnfSyntax::calcRecursionTrees(const QVector<quint32>& comp, const QHash<const Ast::Definition*, quint32>& index,
+                                    const QVector<Ast::NodeList>& uses, const QVector<Ast::NodeList>& cycles,
+                                    QVector<Ast::Node*>& toRoot, QVector<Ast::Node*>& fromRoot)
+{
+    // breadth first from the root along the nonterminals and against them; cycles[x] are the nonterminals
+    // within the component referring to x
+    const quint32 root = comp.first();
+    QVector<quint32> queue;
+    queue.append( root );
+    toRoot[root] = 0;
+    for( int q = 0; q < queue.size(); q++ )
+    {
+        foreach( Ast::Node* use, cycles[queue[q]] )
+        {
+            const quint32 from = index.value( use->d_owner );
+            if( from != root && toRoot[from] == 0 )
+            {
+                toRoot[from] = use;
+                queue.append( from );
+            }
+        }
+    }
+    queue.clear();
+    queue.append( root );
+    fromRoot[root] = 0;
+    for( int q = 0; q < queue.size(); q++ )
+    {
+        foreach( Ast::Node* use, uses[queue[q]] )
+        {
+            const quint32 to = index.value( use->d_def );
+            if( to != root && fromRoot[to] == 0 && std::binary_search( comp.begin(), comp.end(), to ) )
+            {
+                fromRoot[to] = use;
+                queue.append( to );
+            }
+        }
+    }
+}
+
+bool EbnfSyntax::copyLeftRecursion(Ast::Definition* d, const Ast::Definition* prev, const SyntaxDelta& delta)
+{
+    QList<LeftRecursion> l = delta.getPrevSyntax()->d_leftRec.value(prev);
+    for( int i = 0; i < l.size(); i++ )
+    {
+        l[i].d_use = delta.map( l[i].d_use );
+        if( l[i].d_use == 0 )
+            return false;
+        for( int j = 0; j < l[i].d_path.size(); j++ )
+        {
+            l[i].d_path[j] = delta.map( l[i].d_path[j] );
+            if( l[i].d_path[j] == 0 )
+                return false;
+        }
+    }
+    d->d_directLeftRecursive = prev->d_directLeftRecursive;
+    d->d_indirectLeftRecursive = prev->d_indirectLeftRecursive;
+    foreach( const LeftRecursion& rec, l )
+    {
+        rec.d_use->d_flags |= Ast::Node::LeftRecursive;
+        d_pathToDef.insert( rec.d_use->d_id, rec.d_path );
+        reportLeftRecursion(d,rec);
+    }
+    if( !l.isEmpty() )
+        d_leftRec.insert(d,l);
+    return true;
+}
+
+void EbnfSyntax::reportLeftRecursion(const Ast::Definition* start, const LeftRecursion& rec)
+{
+    if( d_errs == 0 )
+        return;
+    Ast::ConstNodeList l;
+    foreach( Ast::Node* n, rec.d_path )
+        l.append(n);
+    d_errs->error( EbnfErrors::Semantics, rec.d_use->d_tok.d_lineNr, rec.d_use->d_tok.d_colNr,
+                   QString("%1 left recursion with '%2'").
+                   arg(rec.d_direct?"direct":"indirect").arg(start->d_tok.d_val.toStr()),
+                   QVariant::fromValue(EbnfSyntax::IssueData(
+                                           EbnfSyntax::IssueData::LeftRec,start->d_node, rec.d_use,l)));
+}
+
 void EbnfSyntax::checkPragmas()
 {
     if( d_errs == 0 )
@@ -683,7 +1025,7 @@ Ast::NodeRefSet EbnfSyntax::calcStartsWithNtSet(Ast::Node* node)
     if( node == 0 || node->doIgnore() )
         return Ast::NodeRefSet();
 
-    node->d_leftRecursive = false;
+    node->d_flags &= ~Ast::Node::LeftRecursive;
     Ast::NodeRefSet res;
     switch( node->d_type )
     {
@@ -799,98 +1141,246 @@ void EbnfSyntax::checkPredicates(Ast::Node* node)
             checkPredicates(sub);
 }
 
-bool Ast::Definition::doIgnore() const
+Ast::Arena::~Arena()
 {
-    return d_tok.d_op == EbnfToken::Skip || d_notReachable;
+    foreach( char* chunk, d_chunks )
+        ::free( chunk );
 }
 
-void Ast::Definition::dump() const
+void* Ast::Arena::grow(quint32 size)
 {
-    qDebug() << d_tok.d_val.toStr() << "::=";
-	if( d_node )
-		d_node->dump(1);
-	else
-		qDebug() << "    No nodes";
+    if( size > ChunkSize / 4 )
+    {
+        // large blocks get a chunk of their own so the current one can still be filled
+        char* chunk = static_cast<char*>( ::malloc( size ) );
+        d_chunks.append( chunk );
+        d_allocated += size;
+        return chunk;
+    }
+    d_cur = static_cast<char*>( ::malloc( ChunkSize ) );
+    d_end = d_cur + ChunkSize;
+    d_chunks.append( d_cur );
+    d_allocated += ChunkSize;
+    void* res = d_cur;
+    d_cur += size;
+    return res;
 }
 
-Ast::Node::~Node()
+int Ast::NodeArray::indexOf(const Ast::Node* n) const
 {
-	foreach( Node* n, d_subs )
-        delete n;
+    for( quint32 i = 0; i < d_size; i++ )
+    {
+        if( d_data[i] == n )
+            return i;
+    }
+    return -1;
 }
 
-bool Ast::Node::doIgnore() const
+void Ast::NodeArray::reserve(Ast::Arena& a, quint32 cap)
 {
-    return d_type == Predicate || d_tok.d_op == EbnfToken::Skip ||
-            ( d_def != 0 && d_def->doIgnore() && d_tok.d_op != EbnfToken::Keep );
+    if( cap <= d_cap )
+        return;
+    // the old elements stay in the arena until the syntax is dropped
+    Node** data = static_cast<Node**>( a.alloc( cap * sizeof(Node*) ) );
+    if( d_size )
+        ::memcpy( data, d_data, d_size * sizeof(Node*) );
+    d_data = data;
+    d_cap = cap;
 }
 
-bool Ast::Node::isNullable() const
+void Ast::NodeArray::append(Ast::Arena& a, Ast::Node* n)
 {
-    if( d_quant != One )
-        return true;
-    switch( d_type )
+    if( d_size == d_cap )
+        reserve( a, d_cap == 0 ? 4 : 2 * d_cap );
+    d_data[d_size++] = n;
+}
+
+void Ast::NodeArray::append(Ast::Arena& a, const Ast::NodeArray& rhs)
+{
+    reserve( a, d_size + rhs.d_size );
+    if( rhs.d_size )
+        ::memcpy( d_data + d_size, rhs.d_data, rhs.d_size * sizeof(Node*) );
+    d_size += rhs.d_size;
+}
+
+void Ast::NodeArray::assign(Ast::Arena& a, const Ast::NodeList& l)
+{
+    d_size = 0;
+    reserve( a, l.size() );
+    foreach( Node* n, l )
+        d_data[d_size++] = n;
+}
+
+bool Ast::BitSet::unite(const Ast::BitSet& rhs)
+{
+    if( rhs.d_words.isEmpty() )
+        return false;
+    if( d_words.isEmpty() )
     {
-    case Nonterminal:
-        if( d_def )
-            return d_def->isNullable();
-        else
+        d_words = rhs.d_words;
+        return !isEmpty();
+    }
+    Q_ASSERT( d_words.size() == rhs.d_words.size() );
+    const quint64* r = rhs.d_words.constData();
+    const int n = d_words.size();
+    int i = 0;
+    // only detach if there is something to add
+    while( i < n && ( r[i] & ~d_words.at(i) ) == 0 )
+        i++;
+    if( i == n )
+        return false;
+    quint64* l = d_words.data();
+    for( ; i < n; i++ )
+        l[i] |= r[i];
+    return true;
+}
+
+bool Ast::BitSet::intersects(const Ast::BitSet& rhs) const
+{
+    const int n = qMin( d_words.size(), rhs.d_words.size() );
+    for( int i = 0; i < n; i++ )
+    {
+        if( d_words.at(i) & rhs.d_words.at(i) )
+            return true;
+    }
+    return false;
+}
+
+Ast::BitSet Ast::BitSet::operator&(const Ast::BitSet& rhs) const
+{
+    BitSet res;
+    if( !intersects(rhs) )
+        return res;
+    res.d_words.resize( qMin( d_words.size(), rhs.d_words.size() ) );
+    for( int i = 0; i < res.d_words.size(); i++ )
+        res.d_words[i] = d_words.at(i) & rhs.d_words.at(i);
+    return res;
+}
+
+bool Ast::BitSet::isEmpty() const
+{
+    for( int i = 0; i < d_words.size(); i++ )
+    {
+        if( d_words.at(i) )
             return false;
-    case Sequence:
-        foreach( Node* n, d_subs )
+    }
+    return true;
+}
+
+quint32 Ast::BitSet::count() const
+{
+    quint32 res = 0;
+    for( int i = 0; i < d_words.size(); i++ )
+    {
+        quint64 w = d_words.at(i);
+        while( w )
         {
-            if( n->doIgnore() )
-                continue;
-            if( !n->isNullable() )
-                return false;
+            w &= w - 1;
+            res++;
         }
-        return true;
-    case Alternative:
-        foreach( Node* n, d_subs )
+    }
+    return res;
+}
+
+quint32 Ast::BitSet::nextBit(quint32 from) const
+{
+    quint32 i = from >> 6;
+    if( i >= quint32(d_words.size()) )
+        return Invalid;
+    quint64 w = d_words.at(i) >> ( from & 63 );
+    if( w == 0 )
+    {
+        from = 0;
+        for( i++; i < quint32(d_words.size()); i++ )
         {
-            if( n->doIgnore() )
-                continue;
-            if( n->isNullable() )
-                return true;
+            if( ( w = d_words.at(i) ) != 0 )
+                break;
         }
-        return false;
-    default:
-        break;
+        if( w == 0 )
+            return Invalid;
+    }else
+        from &= 63;
+    while( ( w & 1 ) == 0 )
+    {
+        w >>= 1;
+        from++;
     }
-    return false;
+    return i * 64 + from;
 }
 
-bool Ast::Node::isRepeatable() const
+bool Ast::BitSet::operator==(const Ast::BitSet& rhs) const
 {
-    if( d_quant == ZeroOrMore )
-        return true;
+    // sets of different width are equal if they have the same bits
+    const int n = qMin( d_words.size(), rhs.d_words.size() );
+    for( int i = 0; i < n; i++ )
+    {
+        if( d_words.at(i) != rhs.d_words.at(i) )
+            return false;
+    }
+    for( int i = n; i < d_words.size(); i++ )
+        if( d_words.at(i) )
+            return false;
+    for( int i = n; i < rhs.d_words.size(); i++ )
+        if( rhs.d_words.at(i) )
+            return false;
+    return true;
+}
+
+bool Ast::Definition::doIgnore() const
+{
+    return d_tok.d_op == EbnfToken::Skip || d_notReachable;
+}
+
+void Ast::Definition::dump() const
+{
+    qDebug() << d_tok.d_val.toStr() << "::=";
+	if( d_node )
+		d_node->dump(1);
+	else
+		qDebug() << "    No nodes";
+}
 
-    Node* n = 0;
+quint8 Ast::Node::calcFlags() const
+{
+    const bool ignore = d_type == Predicate || d_tok.d_op == EbnfToken::Skip ||
+            ( d_def != 0 && d_def->doIgnore() && d_tok.d_op != EbnfToken::Keep );
+    bool nullable = d_quant != One;
+    bool repeatable = d_quant == ZeroOrMore;
     switch( d_type )
     {
     case Nonterminal:
         if( d_def )
-            return d_def->isRepeatable();
-        else
-            return false;
+        {
+            nullable |= d_def->isNullable();
+            repeatable |= d_def->isRepeatable();
+        }
+        break;
     case Sequence:
     case Alternative:
-        foreach( Node* sub, d_subs )
         {
-            if( sub->doIgnore() )
-                continue;
-            if( n != 0 )
-                return false;
-            n = sub;
+            bool all = true, any = false;
+            Node* n = 0;
+            int visible = 0;
+            foreach( Node* sub, d_subs )
+            {
+                if( sub->doIgnore() )
+                    continue;
+                if( sub->isNullable() )
+                    any = true;
+                else
+                    all = false;
+                visible++;
+                n = sub;
+            }
+            nullable |= d_type == Sequence ? all : any;
+            if( visible == 1 )
+                repeatable |= n->isRepeatable();
         }
-        if( n )
-            return n->isRepeatable();
-        else
-            return false;
+        break;
     default:
         break;
     }
-    return false;
+    return ( ignore ? Ignored : 0 ) | ( nullable ? Nullable : 0 ) | ( repeatable ? Repeatable : 0 );
 }
 
 bool Ast::Node::isAnyReachable() const
@@ -900,7 +1390,7 @@ bool Ast::Node::isAnyReachable() const
     switch( d_type )
     {
     case Nonterminal:
-        return !d_def->doIgnore();
+        return d_def != 0 && !d_def->doIgnore(); // unresolved if the syntax has errors
     case Terminal:
         return true;
     case Sequence:
@@ -925,25 +1415,55 @@ bool Ast::Node::isAnyReachable() const
 
 const Ast::Node*Ast::Node::getNext(int* index) const
 {
-    Node* parent = d_parent;
-    const Node* me = this;
-    while( parent )
+    // bei Alternative gehe direkt eine Stufe nach oben
+    for( FollowCursor i( this ); !i.atEnd(); ++i )
     {
-        if( parent->d_type == Sequence ) // bei  Alternative gehe direkt eine Stufe nach oben
+        if( i.isRepeat() )
+            continue;
+        if( index )
+            *index += 1;
+        return *i;
+    }
+    return 0;
+}
+
+void Ast::Node::append(Ast::Arena& a, Ast::Node* sub)
+{
+    Q_ASSERT( d_subs.size() < ( 1 << 22 ) ); // see d_pos
+    sub->d_parent = this;
+    sub->d_pos = d_subs.size();
+    d_subs.append( a, sub );
+}
+
+Ast::FollowCursor::FollowCursor(const Ast::Node* n):d_cur(0),d_me(n),d_next(n ? n->d_pos + 1 : 0),d_repeat(false)
+{
+    ++(*this);
+}
+
+Ast::FollowCursor& Ast::FollowCursor::operator++()
+{
+    while( d_me != 0 && d_me->d_parent != 0 )
+    {
+        const Node* parent = d_me->d_parent;
+        if( !d_repeat && parent->d_type == Node::Sequence && d_next < quint32(parent->d_subs.size()) )
         {
-            const int pos = parent->d_subs.indexOf(const_cast<Node*>(me));
-            Q_ASSERT( pos != -1 );
-            if( pos + 1 < parent->d_subs.size() )
-            {
-                if( index )
-                    *index += 1;
-                return parent->d_subs[pos+1];
-            }
+            d_cur = parent->d_subs[d_next++];
+            return *this;
         }
-        me = parent;
-        parent = parent->d_parent;
+        if( !d_repeat && parent->d_quant == Node::ZeroOrMore )
+        {
+            d_cur = parent;
+            d_repeat = true;
+            return *this;
+        }
+        // the level of parent is done
+        d_me = parent;
+        d_next = parent->d_pos + 1;
+        d_repeat = false;
     }
-    return 0;
+    d_cur = 0;
+    d_repeat = false;
+    return *this;
 }
 
 int Ast::Node::getLlk() const
@@ -1039,8 +1559,3 @@ bool Ast::NodeRef::operator==(const Ast::NodeRef& rhs) const
         return false; // wegen Lexer::d_symTbl nicht nötig: d_node->d_tok.d_val == rhs.d_node->d_tok.d_val;
 }
 
-
-Ast::Definition::~Definition()
-{
-    if( d_node ) delete d_node;
-}
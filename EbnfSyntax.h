@@ -24,10 +24,14 @@
 #include <QHash>
 #include <QStringList>
 #include <QSet>
+#include <QVector>
 #include <QVariant>
 #include "EbnfToken.h"
+#include "EbnfProfiler.h"
+#include "FlatSyntax.h"
 
 class EbnfErrors;
+class SyntaxDelta;
 
 namespace Ast
 {
@@ -36,11 +40,104 @@ namespace Ast
     typedef QList<const Node*> ConstNodeList;
     typedef QSet<const Node*> NodeSet;
 
+    // Bump allocator owned by EbnfSyntax for its nodes, definitions and child arrays; the memory
+    // is released in one go together with the syntax.
+    class Arena
+    {
+    public:
+        Arena():d_cur(0),d_end(0),d_allocated(0),d_used(0){}
+        ~Arena();
+        void* alloc( quint32 size )
+        {
+            size = ( size + Align - 1 ) & ~quint32( Align - 1 );
+            d_used += size;
+            if( quint32( d_end - d_cur ) < size )
+                return grow( size );
+            void* res = d_cur;
+            d_cur += size;
+            return res;
+        }
+        quint64 getAllocated() const { return d_allocated; }
+        quint64 getUsed() const { return d_used; } // the sum of the allocations
+    private:
+        Q_DISABLE_COPY(Arena)
+        void* grow( quint32 size );
+        enum { ChunkSize = 64 * 1024, Align = 8 };
+        QList<char*> d_chunks;
+        char* d_cur;
+        char* d_end;
+        quint64 d_allocated;
+        quint64 d_used;
+    };
+
+    // Array of child nodes in arena memory; copies share the elements
+    class NodeArray
+    {
+    public:
+        typedef Node* value_type;
+        typedef Node* const* const_iterator;
+        typedef Node** iterator;
+        NodeArray():d_data(0),d_size(0),d_cap(0){}
+        int size() const { return d_size; }
+        int count() const { return d_size; }
+        bool isEmpty() const { return d_size == 0; }
+        Node* at( int i ) const { Q_ASSERT( i >= 0 && quint32(i) < d_size ); return d_data[i]; }
+        Node* operator[]( int i ) const { return at(i); }
+        Node*& operator[]( int i ) { Q_ASSERT( i >= 0 && quint32(i) < d_size ); return d_data[i]; }
+        Node* first() const { return at(0); }
+        Node* last() const { return at(d_size-1); }
+        Node* back() const { return last(); }
+        const_iterator begin() const { return d_data; }
+        const_iterator end() const { return d_data + d_size; }
+        const_iterator constBegin() const { return d_data; }
+        const_iterator constEnd() const { return d_data + d_size; }
+        iterator begin() { return d_data; }
+        iterator end() { return d_data + d_size; }
+        int indexOf( const Node* ) const;
+        void append( Arena&, Node* );
+        void append( Arena&, const NodeArray& );
+        void assign( Arena&, const NodeList& );
+        void clear() { d_size = 0; }
+    private:
+        void reserve( Arena&, quint32 );
+        Node** d_data;
+        quint32 d_size;
+        quint32 d_cap;
+    };
+
+    // Fixed-width set of small integers, e.g. dense terminal ids; copies share the words until modified.
+    // A default constructed set is empty and adopts the width of the first set united with it.
+    class BitSet
+    {
+    public:
+        enum { Invalid = 0xffffffff };
+        BitSet(){}
+        explicit BitSet( quint32 width ):d_words( ( width + 63 ) / 64, 0 ){}
+        quint32 width() const { return d_words.size() * 64; }
+        bool testBit( quint32 i ) const
+            { return i < width() && ( d_words[i >> 6] >> ( i & 63 ) & 1 ); }
+        void setBit( quint32 i ) { Q_ASSERT( i < width() ); d_words[i >> 6] |= quint64(1) << ( i & 63 ); }
+        bool unite( const BitSet& ); // returns true if bits were added
+        bool intersects( const BitSet& ) const;
+        BitSet operator&( const BitSet& ) const;
+        bool isEmpty() const;
+        quint32 count() const;
+        quint32 nextBit( quint32 from ) const; // Invalid if there is no set bit at or after from
+        bool operator==( const BitSet& ) const;
+        bool operator!=( const BitSet& rhs ) const { return !( *this == rhs ); }
+    private:
+        QVector<quint64> d_words;
+    };
+
     struct Symbol
     {
         EbnfToken d_tok;
         Symbol( const EbnfToken& tok = EbnfToken() ):d_tok(tok) {}
         virtual ~Symbol() {}
+        // nodes and definitions are created with new(arena); delete only runs the destructor
+        static void* operator new( size_t size, Arena& a ) { return a.alloc( size ); }
+        static void operator delete( void*, Arena& ) {}
+        static void operator delete( void* ) {}
         virtual bool doIgnore() const { return false; }
         virtual bool isNullable() const { return false; }
         virtual bool isRepeatable() const { return false; }
@@ -57,8 +154,7 @@ namespace Ast
         bool d_indirectLeftRecursive;
         bool d_notReachable;
         Definition(const EbnfToken& tok):Symbol(tok),d_node(0),d_nullable(false),d_repeatable(false),
-            d_directLeftRecursive(false),d_indirectLeftRecursive(false),d_notReachable(false){}
-        ~Definition();
+            d_directLeftRecursive(false),d_indirectLeftRecursive(false),d_notReachable(false){ EbnfProfiler::countAlloc(); }
         bool doIgnore() const;
         bool isNullable() const { return d_nullable; }
         bool isRepeatable() const { return d_repeatable; }
@@ -70,28 +166,28 @@ namespace Ast
         enum Type { Terminal, Nonterminal, Sequence, Alternative, Predicate };
         enum Quantity { One, ZeroOrOne, ZeroOrMore };
         static const char* s_typeName[];
-    #ifdef _DEBUG
-        Type d_type;
-        Quantity d_quant;
-    #else
-        quint8 d_type;
-        quint8 d_quant;
-    #endif
-        bool d_leftRecursive;
-        bool d_literal;
-        NodeList d_subs; // owned
-        NodeList d_pathToDef;
+        enum Flag { Ignored = 1, Nullable = 2, Repeatable = 4, // cached by EbnfSyntax::finishSyntax, see calcFlags
+                    Literal = 8, LeftRecursive = 16, Cached = Ignored | Nullable | Repeatable };
+        // the fields read by the analysis passes share one word in all builds; see the size check in EbnfSyntax.cpp
+        uint d_type : 3; // Type
+        uint d_quant : 2; // Quantity
+        uint d_flags : 5; // Flag
+        uint d_pos : 22; // index in d_parent->d_subs
+        quint32 d_id; // index in the FlatSyntax, or FlatSyntax::Invalid; the left recursion paths are kept by id
+        NodeArray d_subs;
         Definition* d_owner;
         Definition* d_def; // resolved nonterminal
         Node* d_parent; // TODO: ev. unnötig; man kann damit bottom up über Sequence hinweg schauen
         Node(Type t, Definition* d, const EbnfToken& tok = EbnfToken(), bool lit = false):Symbol(tok),d_type(t),
-            d_quant(One),d_owner(d),d_def(0),d_parent(0),d_leftRecursive(false),d_literal(lit){}
-        Node(Type t, Node* parent, const EbnfToken& tok = EbnfToken()):Symbol(tok),d_type(t),
-            d_quant(One),d_owner(parent->d_owner),d_def(0),d_parent(parent),d_leftRecursive(false){ parent->d_subs.append(this); }
-        ~Node();
-        bool doIgnore() const;
-        bool isNullable() const;
-        bool isRepeatable() const;
+            d_quant(One),d_flags(lit ? Literal : 0),d_pos(0),d_id(0xffffffff),d_owner(d),d_def(0),d_parent(0)
+            { EbnfProfiler::countAlloc(); }
+        void append( Arena&, Node* sub ); // sets the parent and position of sub
+        bool doIgnore() const { return d_flags & Ignored; }
+        bool isNullable() const { return d_flags & Nullable; }
+        bool isRepeatable() const { return d_flags & Repeatable; }
+        bool isLiteral() const { return d_flags & Literal; }
+        bool isLeftRecursive() const { return d_flags & LeftRecursive; } // starts a path of left recursion
+        quint8 calcFlags() const; // from the flags of the subs and the resolved definition
         bool isAnyReachable() const;
         const Node* getNext(int* index = 0) const;
         int getLlk() const; // 0..invalid
@@ -102,6 +198,25 @@ namespace Ast
     };
     typedef QSet<Definition*> DefSet;
 
+    // Steps through what can come after a node up to the end of its definition, nearest first: the later
+    // elements of each enclosing sequence, ignored ones included, and each enclosing repetition, which can
+    // start again. Each step is constant time.
+    class FollowCursor
+    {
+    public:
+        FollowCursor( const Node* );
+        const Node* operator*() const { return d_cur; } // 0 at the end
+        bool atEnd() const { return d_cur == 0; }
+        bool isRepeat() const { return d_repeat; } // the current node is an enclosing repetition
+        const Node* getTop() const { return d_me; } // the outermost node visited so far
+        FollowCursor& operator++();
+    private:
+        const Node* d_cur;
+        const Node* d_me; // d_cur is a later sibling of d_me or the parent of d_me
+        quint32 d_next;
+        bool d_repeat;
+    };
+
     struct NodeRef
     {
         const Node* d_node;
@@ -161,6 +276,7 @@ public:
 
     void clear();
     EbnfErrors* getErrs() const { return d_errs; }
+    void setErrs( EbnfErrors* errs ) { d_errs = errs; } // e.g. when the syntax was built in a worker thread
 
     typedef QHash<EbnfToken::Sym,Ast::Definition*> Definitions;
     typedef QList<Ast::Definition*> OrderedDefs;
@@ -181,10 +297,33 @@ public:
     void setKeywords( const Keywords& kw ) { d_kw = kw; }
     const Keywords& getKeywords() const { return d_kw; }
 
-    bool finishSyntax();
+    // prev is an earlier version of the same text; the facts of the definitions not affected by the
+    // differences are taken over from there instead of being computed again
+    bool finishSyntax( const EbnfSyntax* prev = 0 );
+    bool isFinished() const { return d_finished; } // false if finishSyntax failed, e.g. on unresolved symbols
+    quint32 getRecomputed() const { return d_recomputed; } // definitions analyzed by finishSyntax
+    Ast::Arena& getArena() { return d_arena; }
+    const Ast::Arena& getArena() const { return d_arena; }
+    const FlatSyntax& getFlat() const { return d_flat; } // valid after finishSyntax
 
+    // Dense ids valid after finishSyntax; terminals (keywords, literals, terminal productions and unresolved
+    // symbols) are numbered 0..getTermCount()-1, nonterminal productions follow up to getSymIdCount()-1.
+    enum { InvalidId = 0xffffffff };
+    quint32 getSymId( const EbnfToken::Sym& sym ) const
+        { const quint32 i = sym.getId(); return i < quint32(d_symIds.size()) ? d_symIds[i] : quint32(InvalidId); }
+    quint32 getSymId( const Ast::Node* n ) const { return n ? getSymId( n->d_tok.d_val ) : quint32(InvalidId); }
+    EbnfToken::Sym getSymById( quint32 id ) const { return d_idSyms.value(id); }
+    quint32 getTermCount() const { return d_termCount; }
+    quint32 getNtCount() const { return d_idSyms.size() - d_termCount; }
+    quint32 getSymIdCount() const { return d_idSyms.size(); }
+    bool isTermId( quint32 id ) const { return id < d_termCount; }
+
+    // the position queries use an index built by finishSyntax
     const Ast::Symbol* findSymbolBySourcePos( quint32 line, quint16 col , bool nonTermOnly = true ) const;
+    typedef QList<const Ast::Symbol*> ConstSymList;
+    ConstSymList findSymbolsInLines( quint32 fromLine, quint32 toLine, bool nonTermOnly = true ) const; // in source order
     Ast::ConstNodeList getBackRefs( const Ast::Symbol* ) const;
+    Ast::NodeList getPathToDef( const Ast::Node* use ) const { return d_pathToDef.value(use->d_id); } // of a left recursive use
     static const Ast::Node* firstVisibleElementOf( const Ast::Node* );
     static const Ast::Node* firstPredicateOf( const Ast::Node* );
 
@@ -196,12 +335,35 @@ public:
     void dump() const;
 protected:
     bool resolveAllSymbols();
-    void calculateNullable();
+    void calculateNullable( const SyntaxDelta*, QBitArray& recomputed );
     void checkReachability();
-    bool resolveAllSymbols( Ast::Node *node );
-    const Ast::Symbol* findSymbolBySourcePosImp( const Ast::Node*, quint32 line, quint16 col, bool nonTermOnly ) const;
-    void calcLeftRecursion();
-    void markLeftRecursion( Ast::Definition*,Ast::Node* node, Ast::NodeList& );
+    bool resolveAllSymbols( Ast::Node *node, const QVector<quint32>& index, QVector<quint32>& refs );
+    void initNodeFlags();
+    static void initNodeFlags( Ast::Node* );
+    void numberSymbols();
+    void numberTerminals( const Ast::Node* );
+    quint32 numberSymbol( const EbnfToken::Sym& );
+    struct SymbolPos
+    {
+        const Ast::Symbol* d_sym; // a definition, a terminal or a nonterminal
+        bool d_nonTerm; // a Nonterminal node
+    };
+    static bool symbolPosLessThan( const SymbolPos&, const SymbolPos& );
+    void indexSymbolPositions();
+    void indexSymbolPositions( const Ast::Node* );
+    struct LeftRecursion
+    {
+        Ast::Node* d_use; // the nonterminal referring to the start of the path
+        Ast::NodeList d_path;
+        bool d_direct; // as reported
+    };
+    void calcLeftRecursion( const SyntaxDelta*, QBitArray& recomputed );
+    static void collectStartUses( Ast::Node*, Ast::NodeList& );
+    static void calcRecursionTrees( const QVector<quint32>& comp, const QHash<const Ast::Definition*,quint32>& index,
+                                    const QVector<Ast::NodeList>& uses, const QVector<Ast::NodeList>& cycles,
+                                    QVector<Ast::Node*>& toRoot, QVector<Ast::Node*>& fromRoot );
+    bool copyLeftRecursion( Ast::Definition*, const Ast::Definition* prev, const SyntaxDelta& );
+    void reportLeftRecursion( const Ast::Definition*, const LeftRecursion& );
     void checkPragmas();
     Ast::NodeRefSet calcStartsWithNtSet( Ast::Node* node );
     void checkPredicates();
@@ -209,6 +371,7 @@ protected:
 
 private:
     Q_DISABLE_COPY(EbnfSyntax)
+    Ast::Arena d_arena; // owns all nodes and definitions
     EbnfErrors* d_errs;
     Definitions d_defs;
     OrderedDefs d_order;
@@ -218,6 +381,16 @@ private:
     BackRefs d_backRefs;
     IfDefOutList d_idol;
     Keywords d_kw;
+    QVector<quint32> d_symIds; // EbnfToken::Sym::getId() -> dense id
+    SymList d_idSyms; // dense id -> Sym
+    quint32 d_termCount;
+    QVector<SymbolPos> d_symsByPos; // ordered by line and column
+    FlatSyntax::Graph d_refs; // by definition in d_order, the ones referenced by a use which is not skipped
+    FlatSyntax d_flat;
+    QHash<const Ast::Definition*,QList<LeftRecursion> > d_leftRec; // by start definition in the order reported
+    QHash<quint32,Ast::NodeList> d_pathToDef; // by Ast::Node::d_id of the left recursive use
+    quint32 d_recomputed;
+    quint32 d_symGen; // keeps the symbols interned since construction in the pool
     bool d_finished;
 };
 
@@ -18,6 +18,15 @@
 */
 
 #include "EbnfToken.h"
+#include <QVector>
+#include <QMap>
+#include <QMutex>
+#include <QThread>
+#include <QThreadStorage>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
 
 QString EbnfToken::toString(bool labeled) const
 {
@@ -88,7 +97,357 @@ QString EbnfToken::toString(bool labeled) const
     return QByteArray();
 }
 
-QHash<QByteArray,EbnfToken::Sym> EbnfToken::s_symTbl;
+namespace
+{
+// Symbols live in large chunks; each entry is a header ending with the id, followed by the zero terminated
+// utf-8 string. A symbol is stamped with the generation in which it was last interned or looked up;
+// resetSymTbl releases the symbols older than any live generation, and a chunk is freed as soon as all its
+// symbols are gone. Since a parse interns its transient symbols (comments, identifiers being typed) in one
+// go, they usually share chunks which are then returned as a whole.
+// Existing symbols are looked up without a lock, so several lexers can run in parallel. The lookup table
+// only changes under the lock and is replaced when it gets too full. A lookup announces the current epoch in
+// the Reader of its thread; memory no longer reachable from the table is only freed after all lookups of the
+// epoch in which it was removed are done. A released symbol is marked Dead first, which competes with a lookup
+// stamping it.
+static const char s_removed = 0; // entry of a released symbol in the table
+
+struct SymPool
+{
+    enum { ChunkSize = 64 * 1024, NoChunk = 0xffffffff, MinTableSize = 1024 };
+    enum { Dead = 0, Pinned = 0x7fffffff };
+    struct Header
+    {
+        QAtomicInt d_gen;
+        quint32 d_len;
+        quint32 d_id; // last, see Sym::getId
+    };
+    struct Chunk
+    {
+        char* d_data;
+        quint32 d_size;
+        quint32 d_used;
+        quint32 d_live;
+        Chunk():d_data(0),d_size(0),d_used(0),d_live(0){}
+    };
+    struct Slot
+    {
+        const char* d_str; // 0 if free
+        quint32 d_chunk;
+        Slot():d_str(0),d_chunk(NoChunk){}
+    };
+    // the epoch of the lookup running in a thread; owned by one thread at a time and reused by the threads
+    // started later, never freed
+    struct Reader
+    {
+        enum { Idle = -1 };
+        QAtomicInt d_epoch; // first and padded so each thread writes its own cache line
+        char d_pad[64 - sizeof(QAtomicInt)];
+        QAtomicInt d_owned;
+        Reader* d_next;
+        Reader():d_epoch(Idle),d_owned(1),d_next(0){}
+    };
+    struct ReaderRef
+    {
+        Reader* d_reader;
+        ReaderRef( Reader* r ):d_reader(r){}
+        ~ReaderRef() { d_reader->d_owned.storeRelease(0); }
+    };
+    // open addressing with linear probing, at most half full including the removed entries
+    struct Table
+    {
+        QAtomicPointer<const char>* d_entries;
+        quint32 d_mask;
+        quint32 d_used; // entries not 0
+        Table( quint32 size ):d_entries( new QAtomicPointer<const char>[size] ),d_mask(size - 1),d_used(0){}
+        ~Table() { delete[] d_entries; }
+    };
+
+    QAtomicPointer<Table> d_tbl;
+    QVector<Slot> d_slots; // index is id, slot 0 stands for the null Sym
+    QVector<quint32> d_freeIds;
+    QVector<Chunk> d_chunks;
+    QVector<quint32> d_freeChunks;
+    QList<char*> d_retiredChunks; // not in use anymore, but possibly read by a lookup
+    QList<Table*> d_retiredTables;
+    QMap<quint32,quint32> d_liveGens; // generation -> number of users
+    QMutex d_lock; // all but the lookups
+    QAtomicInt d_gen;
+    QAtomicInt d_epoch;
+    QAtomicPointer<Reader> d_readers; // list of all Readers, only prepended to
+    QThreadStorage<ReaderRef*> d_reader;
+    quint32 d_cur;   // chunk currently allocated from
+    quint32 d_count;
+    quint32 d_pinned;
+    quint64 d_used;
+    quint64 d_reclaimed;
+
+    SymPool():d_tbl( new Table(MinTableSize) ),d_slots(1),d_gen(1),d_cur(NoChunk),d_count(0),d_pinned(0),
+        d_used(0),d_reclaimed(0) {}
+    ~SymPool()
+    {
+        for( int i = 0; i < d_chunks.size(); i++ )
+            ::free( d_chunks[i].d_data );
+        freeRetired();
+        delete d_tbl.loadRelaxed();
+    }
+    static quint32 entrySize( quint32 len )
+    {
+        // header, string and terminating zero, aligned so the next header is aligned too
+        const quint32 n = sizeof(Header) + len + 1;
+        return ( n + sizeof(quint32) - 1 ) & ~quint32( sizeof(quint32) - 1 );
+    }
+    static Header* header( const char* str )
+    {
+        return reinterpret_cast<Header*>( const_cast<char*>( str ) - sizeof(Header) );
+    }
+    static const char* find( const Table* t, const QByteArray& str, uint hash )
+    {
+        for( quint32 i = hash & t->d_mask; ; i = ( i + 1 ) & t->d_mask )
+        {
+            const char* e = t->d_entries[i].loadAcquire();
+            if( e == 0 )
+                return 0;
+            if( e != &s_removed && header(e)->d_len == quint32(str.size()) &&
+                    ::memcmp( e, str.constData(), str.size() ) == 0 )
+                return e;
+        }
+    }
+    bool stamp( const char* str )
+    {
+        QAtomicInt& gen = header(str)->d_gen;
+        const int cur = d_gen.loadAcquire();
+        while( true )
+        {
+            const int g = gen.loadAcquire();
+            if( g == Dead )
+                return false;
+            if( g >= cur ) // includes Pinned
+                return true;
+            if( gen.testAndSetOrdered( g, cur ) )
+                return true;
+        }
+    }
+    Reader* reader()
+    {
+        if( d_reader.hasLocalData() )
+            return d_reader.localData()->d_reader;
+        Reader* r = d_readers.loadAcquire();
+        while( r != 0 && !r->d_owned.testAndSetAcquire( 0, 1 ) )
+            r = r->d_next;
+        if( r == 0 )
+        {
+            r = new Reader();
+            do
+                r->d_next = d_readers.loadAcquire();
+            while( !d_readers.testAndSetRelease( r->d_next, r ) );
+        }
+        d_reader.setLocalData( new ReaderRef(r) );
+        return r;
+    }
+    const char* lookup( const QByteArray& str, uint hash )
+    {
+        Reader* r = reader();
+        int epoch = d_epoch.loadAcquire();
+        while( true )
+        {
+            // synchronize either sees the announcement or the lookup sees the new epoch
+            r->d_epoch.fetchAndStoreOrdered( epoch );
+            const int cur = d_epoch.loadAcquire();
+            if( cur == epoch )
+                break;
+            epoch = cur;
+        }
+        const char* res = find( d_tbl.loadAcquire(), str, hash );
+        if( res != 0 && !stamp( res ) )
+            res = 0;
+        r->d_epoch.storeRelease( Reader::Idle );
+        return res;
+    }
+    void synchronize()
+    {
+        // the lookups starting from now on cannot see what was removed so far
+        const int epoch = d_epoch.loadRelaxed();
+        d_epoch.fetchAndStoreOrdered( ( epoch + 1 ) & 0x7fffffff ); // never Reader::Idle
+        for( Reader* r = d_readers.loadAcquire(); r != 0; r = r->d_next )
+        {
+            while( r->d_epoch.loadAcquire() == epoch )
+                QThread::yieldCurrentThread();
+        }
+        freeRetired();
+    }
+    void freeRetired()
+    {
+        foreach( char* data, d_retiredChunks )
+            ::free( data );
+        d_retiredChunks.clear();
+        qDeleteAll( d_retiredTables );
+        d_retiredTables.clear();
+    }
+    void put( Table* t, const char* str, uint hash )
+    {
+        for( quint32 i = hash & t->d_mask; ; i = ( i + 1 ) & t->d_mask )
+        {
+            const char* e = t->d_entries[i].loadRelaxed();
+            if( e == 0 || e == &s_removed )
+            {
+                if( e == 0 )
+                    t->d_used++;
+                t->d_entries[i].storeRelease( str );
+                return;
+            }
+        }
+    }
+    void rehash( quint32 size )
+    {
+        Table* old = d_tbl.loadRelaxed();
+        Table* t = new Table( size );
+        for( quint32 i = 0; i <= old->d_mask; i++ )
+        {
+            const char* e = old->d_entries[i].loadRelaxed();
+            if( e != 0 && e != &s_removed )
+                put( t, e, qHash( QByteArray::fromRawData( e, header(e)->d_len ) ) );
+        }
+        d_tbl.storeRelease( t );
+        d_retiredTables.append( old );
+    }
+    static quint32 tableSize( quint32 count )
+    {
+        quint32 size = MinTableSize;
+        while( size < count * 4 )
+            size *= 2;
+        return size;
+    }
+    void remove( const char* str )
+    {
+        Table* t = d_tbl.loadRelaxed();
+        const uint hash = qHash( QByteArray::fromRawData( str, header(str)->d_len ) );
+        for( quint32 i = hash & t->d_mask; ; i = ( i + 1 ) & t->d_mask )
+        {
+            const char* e = t->d_entries[i].loadRelaxed();
+            Q_ASSERT( e != 0 );
+            if( e == str )
+            {
+                t->d_entries[i].storeRelease( &s_removed );
+                return;
+            }
+        }
+    }
+    quint32 newChunk( quint32 size )
+    {
+        quint32 i;
+        if( !d_freeChunks.isEmpty() )
+        {
+            i = d_freeChunks.last();
+            d_freeChunks.pop_back();
+        }else
+        {
+            i = d_chunks.size();
+            d_chunks.append( Chunk() );
+        }
+        Chunk& c = d_chunks[i];
+        c.d_data = static_cast<char*>( ::malloc( size ) );
+        c.d_size = size;
+        c.d_used = 0;
+        c.d_live = 0;
+        return i;
+    }
+    void freeChunk( quint32 i )
+    {
+        d_retiredChunks.append( d_chunks[i].d_data );
+        d_chunks[i] = Chunk();
+        d_freeChunks.append( i );
+    }
+    const char* insert( const QByteArray& str, uint hash )
+    {
+        const quint32 size = entrySize( str.size() );
+        quint32 chunk;
+        if( size > ChunkSize / 4 )
+            chunk = newChunk( size ); // large strings get a chunk of their own
+        else
+        {
+            if( d_cur == NoChunk || d_chunks[d_cur].d_used + size > d_chunks[d_cur].d_size )
+            {
+                if( d_cur != NoChunk && d_chunks[d_cur].d_live == 0 )
+                    freeChunk( d_cur );
+                d_cur = newChunk( ChunkSize );
+            }
+            chunk = d_cur;
+        }
+        Chunk& c = d_chunks[chunk];
+
+        quint32 id;
+        if( !d_freeIds.isEmpty() )
+        {
+            id = d_freeIds.last();
+            d_freeIds.pop_back();
+        }else
+        {
+            id = d_slots.size();
+            d_slots.append( Slot() );
+        }
+
+        Header* h = new( c.d_data + c.d_used ) Header();
+        h->d_gen.storeRelaxed( d_gen.loadRelaxed() );
+        h->d_len = str.size();
+        h->d_id = id;
+        char* data = reinterpret_cast<char*>( h ) + sizeof(Header);
+        ::memcpy( data, str.constData(), str.size() );
+        data[str.size()] = 0;
+        c.d_used += size;
+        c.d_live++;
+
+        Slot& s = d_slots[id];
+        s.d_str = data;
+        s.d_chunk = chunk;
+        d_used += size;
+        d_count++;
+        if( ( d_tbl.loadRelaxed()->d_used + 1 ) * 2 > d_tbl.loadRelaxed()->d_mask + 1 )
+            rehash( tableSize( d_count ) );
+        put( d_tbl.loadRelaxed(), data, hash );
+        return data;
+    }
+    void reclaim()
+    {
+        const int cur = d_gen.loadRelaxed();
+        const int oldest = d_liveGens.isEmpty() ? cur : qMin( int(d_liveGens.firstKey()), cur );
+        for( int id = 1; id < d_slots.size(); id++ )
+        {
+            Slot& s = d_slots[id];
+            if( s.d_str == 0 )
+                continue;
+            QAtomicInt& gen = header(s.d_str)->d_gen;
+            const int g = gen.loadAcquire();
+            // Pinned is always >= oldest; a symbol stamped in the meantime is kept
+            if( g >= oldest || !gen.testAndSetOrdered( g, Dead ) )
+                continue;
+            remove( s.d_str );
+            d_used -= entrySize( header(s.d_str)->d_len );
+            d_count--;
+            Chunk& c = d_chunks[s.d_chunk];
+            c.d_live--;
+            if( c.d_live == 0 && s.d_chunk != d_cur )
+                freeChunk( s.d_chunk );
+            s = Slot();
+            d_freeIds.append( id );
+            d_reclaimed++;
+        }
+        if( d_cur != NoChunk && d_chunks[d_cur].d_live == 0 )
+        {
+            freeChunk( d_cur );
+            d_cur = NoChunk;
+        }
+        // the removed entries are dropped when they outnumber the symbols
+        const Table* t = d_tbl.loadRelaxed();
+        if( t->d_used - d_count > d_count )
+            rehash( tableSize( d_count ) );
+        if( !d_retiredChunks.isEmpty() || !d_retiredTables.isEmpty() )
+            synchronize();
+        // reuse the lowest ids first to keep them dense
+        std::sort( d_freeIds.begin(), d_freeIds.end(), std::greater<quint32>() );
+    }
+};
+}
+static SymPool s_pool;
 
 QByteArray EbnfToken::Sym::toBa() const
 {
@@ -129,18 +488,84 @@ bool EbnfToken::Sym::isEmpty() const
 
 EbnfToken::Sym EbnfToken::getSym(const QByteArray& str)
 {
-    Sym& sym = s_symTbl[str];
-    if( sym.d_str == 0 )
-        sym.d_str = str.constData();
+    Sym sym;
+    const uint hash = qHash(str);
+    sym.d_str = s_pool.lookup( str, hash );
+    if( sym.d_str != 0 )
+        return sym;
+    QMutexLocker lock(&s_pool.d_lock);
+    // the symbols are only released under the lock, so one found here is alive
+    sym.d_str = SymPool::find( s_pool.d_tbl.loadRelaxed(), str, hash );
+    if( sym.d_str != 0 )
+        s_pool.stamp( sym.d_str );
+    else
+        sym.d_str = s_pool.insert( str, hash );
 
     //qDebug() << str << (void*)(atom.constData());
 
     return sym;
 }
 
+quint32 EbnfToken::getSymCount()
+{
+    QMutexLocker lock(&s_pool.d_lock);
+    return s_pool.d_slots.size();
+}
+
+void EbnfToken::pinSym(const Sym& sym)
+{
+    if( sym.d_str == 0 )
+        return;
+    QMutexLocker lock(&s_pool.d_lock);
+    if( SymPool::header(sym.d_str)->d_gen.fetchAndStoreOrdered( SymPool::Pinned ) != SymPool::Pinned )
+        s_pool.d_pinned++;
+}
+
+quint32 EbnfToken::acquireSymGeneration()
+{
+    QMutexLocker lock(&s_pool.d_lock);
+    const quint32 gen = s_pool.d_gen.loadRelaxed();
+    s_pool.d_liveGens[gen]++;
+    return gen;
+}
+
+void EbnfToken::releaseSymGeneration(quint32 gen)
+{
+    QMutexLocker lock(&s_pool.d_lock);
+    QMap<quint32,quint32>::iterator i = s_pool.d_liveGens.find(gen);
+    if( i == s_pool.d_liveGens.end() )
+        return;
+    if( --i.value() == 0 )
+        s_pool.d_liveGens.erase(i);
+}
+
 void EbnfToken::resetSymTbl()
 {
+    QMutexLocker lock(&s_pool.d_lock);
+    s_pool.reclaim();
+    s_pool.d_gen.fetchAndAddOrdered(1);
+}
 
+EbnfToken::SymPoolStats EbnfToken::getSymPoolStats()
+{
+    QMutexLocker lock(&s_pool.d_lock);
+    SymPoolStats res;
+    res.d_count = s_pool.d_count;
+    res.d_pinned = s_pool.d_pinned;
+    res.d_generation = s_pool.d_gen.loadRelaxed();
+    for( int i = 0; i < s_pool.d_chunks.size(); i++ )
+    {
+        if( s_pool.d_chunks[i].d_data )
+        {
+            res.d_chunks++;
+            res.d_allocated += s_pool.d_chunks[i].d_size;
+        }
+    }
+    res.d_allocated += s_pool.d_slots.size() * sizeof(SymPool::Slot);
+    res.d_allocated += ( s_pool.d_tbl.loadRelaxed()->d_mask + 1 ) * sizeof(const char*);
+    res.d_used = s_pool.d_used;
+    res.d_reclaimed = s_pool.d_reclaimed;
+    return res;
 }
 
 bool EbnfToken::isPpType(int tt)
@@ -40,9 +40,12 @@ struct EbnfToken
         int size() const;
         bool isEmpty() const;
         bool operator==(const Sym& rhs) const { return d_str == rhs.d_str; }
+        // dense and stable while the symbol is alive; 1..getSymCount()-1, 0 for the null Sym;
+        // ids of reclaimed symbols are reused
+        quint32 getId() const { return d_str ? *reinterpret_cast<const quint32*>( d_str - sizeof(quint32) ) : 0; }
     private:
         friend class EbnfToken;
-        const char* d_str; // stores utf-8
+        const char* d_str; // stores utf-8, preceded by the id
     };
 
     enum TokenType { Invalid, Production, Assig, NonTerm, Keyword, Literal,
@@ -73,13 +76,32 @@ struct EbnfToken
     bool isErr() const { return d_type == Invalid; }
 
 
+    struct SymPoolStats
+    {
+        quint32 d_count;      // live symbols
+        quint32 d_pinned;
+        quint32 d_chunks;
+        quint32 d_generation;
+        quint64 d_allocated;  // bytes held by the arena chunks and the id table
+        quint64 d_used;       // bytes occupied by live symbols
+        quint64 d_reclaimed;  // symbols released since program start
+        SymPoolStats():d_count(0),d_pinned(0),d_chunks(0),d_generation(0),d_allocated(0),
+            d_used(0),d_reclaimed(0){}
+    };
+
+    // the symbol table may be used from several threads; looking up an existing symbol takes no lock
     static Sym getSym( const QByteArray& );
+    static quint32 getSymCount(); // upper bound of Sym::getId()
+    static void pinSym( const Sym& ); // never reclaimed, e.g. keywords which outlive a syntax
+    // an EbnfSyntax keeps all symbols used in its generation or later alive
+    static quint32 acquireSymGeneration();
+    static void releaseSymGeneration( quint32 );
+    // reclaims the symbols not used since the oldest acquired (or the current) generation
+    // and starts a new generation
     static void resetSymTbl();
+    static SymPoolStats getSymPoolStats();
 
     static bool isPpType(int );
-
-private:
-    static QHash<QByteArray,Sym> s_symTbl;
 };
 
 inline uint qHash(const EbnfToken::Sym& r ) { return qHash(r.data()); }
@@ -20,7 +20,15 @@
 #include "FirstFollowSet.h"
 #include <QtDebug>
 
-FirstFollowSet::FirstFollowSet(QObject *parent) : QObject(parent),d_includeNts(false)
+const char* FirstFollowSet::CacheStats::s_kindName[] =
+{
+    "firstNodes",
+    "firstRefs",
+    "followNodes",
+    "followRefs",
+};
+
+FirstFollowSet::FirstFollowSet(QObject *parent) : QObject(parent),d_flat(0),d_includeNts(false),d_frozen(false)
 {
 
 }
@@ -31,8 +39,24 @@ void FirstFollowSet::setSyntax(EbnfSyntax* syn)
         return;
     clear();
     d_syn = syn;
-    calculateFirstSets();
-    calculateFollowSets();
+    if( syn == 0 )
+        return;
+    d_flat = &syn->getFlat();
+    if( !d_flat->isBuilt() )
+    {
+        // finishSyntax failed or was not called
+        d_ownFlat.build( syn );
+        d_flat = &d_ownFlat;
+    }
+    numberElements();
+    {
+        EbnfProfiler::Scope prof("calculateFirstSets");
+        calculateFirstSets();
+    }
+    {
+        EbnfProfiler::Scope prof("calculateFollowSets");
+        calculateFollowSets();
+    }
 }
 
 void FirstFollowSet::setIncludeNts(bool on)
@@ -43,31 +67,101 @@ void FirstFollowSet::setIncludeNts(bool on)
 void FirstFollowSet::clear()
 {
     d_syn = 0;
+    d_flat = 0;
+    d_ownFlat.clear();
+    d_elems.clear();
+    d_elemOf.clear();
     d_first.clear();
+    d_firstKnown.clear();
     d_follow.clear();
+    d_firstNodes.clear();
+    d_firstRefs.clear();
+    d_followNodes.clear();
+    d_followRefs.clear();
+    d_stats = CacheStats();
+    d_symLeaf.clear();
+    d_llk.clear();
+    d_frozen = false;
+}
+
+void FirstFollowSet::freeze(const QList<quint16>& ks)
+{
+    if( d_flat == 0 || d_frozen )
+        return;
+    for( quint32 i = 0; i < d_flat->getNodeCount(); i++ )
+        getFirstBits( i );
+    LlkState temp;
+    foreach( quint16 k, ks )
+        llkState( k, temp );
+    QHash<quint16,LlkState>::iterator i;
+    for( i = d_llk.begin(); i != d_llk.end(); ++i )
+    {
+        LlkState& s = i.value();
+        if( !s.d_firstDone )
+            calcLlkFirstSets( s );
+        if( !s.d_followDone )
+            calcLlkFollowSets( s );
+        s.d_frozen = true;
+    }
+    d_frozen = true;
+}
+
+void FirstFollowSet::thaw()
+{
+    QHash<quint16,LlkState>::iterator i;
+    for( i = d_llk.begin(); i != d_llk.end(); ++i )
+        i.value().d_frozen = false;
+    d_frozen = false;
 }
 
 Ast::NodeSet FirstFollowSet::getFirstNodeSet(const Ast::Node* node, bool cache) const
 {
-    if( node && node->d_type == Ast::Node::Nonterminal && node->d_def && node->d_def->d_node )
-        node = node->d_def->d_node;
-    Ast::NodeSet res = d_first.value(node);
-    if( res.isEmpty() )
+    QMutexLocker lock( d_frozen ? 0 : &d_lock );
+    const Ast::Node* key = lookupKey(node);
+    QHash<const Ast::Node*,Ast::NodeSet>::const_iterator i = d_firstNodes.find(key);
+    FirstFollowSet* set = const_cast<FirstFollowSet*>(this);
+    if( i != d_firstNodes.end() )
     {
-        res = calculateFirstSet(node);
-        if( !res.isEmpty() && cache )
-        {
-            FirstFollowSet* set = const_cast<FirstFollowSet*>(this);
-            set->d_first[node] = res;
-        }
+        if( !d_frozen )
+            set->d_stats.d_hits[CacheStats::FirstNodes]++;
+        return i.value();
     }
+    if( !d_frozen )
+        set->d_stats.d_misses[CacheStats::FirstNodes]++;
+    Ast::NodeSet res;
+    const quint32 n = indexOf(key);
+    if( n == FlatSyntax::Invalid )
+        res = calculateFirstSet(key); // e.g. pragmas
+    else
+        res = toNodeSet( getFirstBits( n, cache ) );
+    if( cache && !d_frozen )
+        set->d_firstNodes.insert( key, res );
     return res;
 }
 
 Ast::NodeRefSet FirstFollowSet::getFirstSet(const Ast::Node* node, bool cache ) const
 {
-    // TODO: cache if need be
-    return EbnfSyntax::nodeToRefSet( getFirstNodeSet( node, cache ) );
+    QMutexLocker lock( d_frozen ? 0 : &d_lock );
+    const Ast::Node* key = lookupKey(node);
+    QHash<const Ast::Node*,Ast::NodeRefSet>::const_iterator i = d_firstRefs.find(key);
+    FirstFollowSet* set = const_cast<FirstFollowSet*>(this);
+    if( i != d_firstRefs.end() )
+    {
+        if( !d_frozen )
+            set->d_stats.d_hits[CacheStats::FirstRefs]++;
+        return i.value();
+    }
+    if( !d_frozen )
+        set->d_stats.d_misses[CacheStats::FirstRefs]++;
+    Ast::NodeRefSet res;
+    const quint32 n = indexOf(key);
+    if( n == FlatSyntax::Invalid )
+        res = EbnfSyntax::nodeToRefSet( calculateFirstSet(key) );
+    else
+        res = toRefSet( getFirstBits( n, cache ) );
+    if( cache && !d_frozen )
+        set->d_firstRefs.insert( key, res );
+    return res;
 }
 
 Ast::NodeRefSet FirstFollowSet::getFirstSet(const Ast::Definition* d) const
@@ -77,16 +171,37 @@ Ast::NodeRefSet FirstFollowSet::getFirstSet(const Ast::Definition* d) const
     return getFirstSet( d->d_node );
 }
 
+Ast::BitSet FirstFollowSet::getFirstTerms(const Ast::Node* node) const
+{
+    QMutexLocker lock( d_frozen ? 0 : &d_lock );
+    const quint32 i = indexOf(node);
+    if( i == FlatSyntax::Invalid )
+        return toTerms( calculateFirstSet(node) );
+    return toTerms( getFirstBits( i ) );
+}
+
 Ast::NodeSet FirstFollowSet::getFollowNodeSet(const Ast::Node* node) const
 {
-    if( node && node->d_type == Ast::Node::Nonterminal && node->d_def && node->d_def->d_node )
-        node = node->d_def->d_node;
-    Ast::NodeSet res = d_follow.value(node);
     /* Wenn man die Repeats hier berechnet, kommt nicht dasselbe raus wie wenn man sie in calculateFollowSet2 berechnet!
     if( node->d_quant == Ast::Node::ZeroOrMore && doRepeats )
         // Wenn das Element wiederholt wird, erscheint auch sein eigenes First-Set als Teil des Follow-Sets
         res += getFirstSet(1,node);
         */
+    QMutexLocker lock( d_frozen ? 0 : &d_lock );
+    const Ast::Node* key = lookupKey(node);
+    QHash<const Ast::Node*,Ast::NodeSet>::const_iterator i = d_followNodes.find(key);
+    FirstFollowSet* set = const_cast<FirstFollowSet*>(this);
+    if( i != d_followNodes.end() )
+    {
+        if( !d_frozen )
+            set->d_stats.d_hits[CacheStats::FollowNodes]++;
+        return i.value();
+    }
+    if( !d_frozen )
+        set->d_stats.d_misses[CacheStats::FollowNodes]++;
+    const Ast::NodeSet res = toNodeSet( getFollowBits(key) );
+    if( !d_frozen )
+        set->d_followNodes.insert( key, res );
     return res;
 }
 
@@ -99,8 +214,141 @@ Ast::NodeRefSet FirstFollowSet::getFollowSet(const Ast::Definition* d) const
 
 Ast::NodeRefSet FirstFollowSet::getFollowSet(const Ast::Node* node) const
 {
-    // TODO: cache if need be
-    return EbnfSyntax::nodeToRefSet( getFollowNodeSet( node ) );
+    QMutexLocker lock( d_frozen ? 0 : &d_lock );
+    const Ast::Node* key = lookupKey(node);
+    QHash<const Ast::Node*,Ast::NodeRefSet>::const_iterator i = d_followRefs.find(key);
+    FirstFollowSet* set = const_cast<FirstFollowSet*>(this);
+    if( i != d_followRefs.end() )
+    {
+        if( !d_frozen )
+            set->d_stats.d_hits[CacheStats::FollowRefs]++;
+        return i.value();
+    }
+    if( !d_frozen )
+        set->d_stats.d_misses[CacheStats::FollowRefs]++;
+    const Ast::NodeRefSet res = toRefSet( getFollowBits(key) );
+    if( !d_frozen )
+        set->d_followRefs.insert( key, res );
+    return res;
+}
+
+Ast::BitSet FirstFollowSet::getFollowTerms(const Ast::Node* node) const
+{
+    return toTerms( getFollowBits(node) );
+}
+
+quint32 FirstFollowSet::indexOf(const Ast::Node* node) const
+{
+    if( d_flat == 0 || node == 0 )
+        return FlatSyntax::Invalid;
+    return d_flat->indexOf( lookupKey(node) );
+}
+
+const Ast::Node* FirstFollowSet::lookupKey(const Ast::Node* node)
+{
+    if( node && node->d_type == Ast::Node::Nonterminal && node->d_def && node->d_def->d_node )
+        return node->d_def->d_node;
+    return node;
+}
+
+Ast::BitSet FirstFollowSet::getFirstBits(quint32 node, bool cache) const
+{
+    if( d_flat->getType(node) == Ast::Node::Nonterminal && d_flat->getTarget(node) != FlatSyntax::Invalid )
+        node = d_flat->getTarget(node);
+    if( d_firstKnown.testBit(node) )
+        return d_first[node];
+    const Ast::BitSet res = calculateFirstSet(node);
+    if( cache && !d_frozen )
+    {
+        FirstFollowSet* set = const_cast<FirstFollowSet*>(this);
+        set->d_first[node] = res;
+        set->d_firstKnown.setBit(node);
+    }
+    return res;
+}
+
+Ast::BitSet FirstFollowSet::getFollowBits(const Ast::Node* node) const
+{
+    if( d_follow.isEmpty() )
+        return Ast::BitSet();
+    if( node == 0 )
+        return d_follow.last();
+    const quint32 i = indexOf(node);
+    if( i == FlatSyntax::Invalid )
+        return Ast::BitSet();
+    return d_follow[i];
+}
+
+Ast::BitSet FirstFollowSet::leaf(quint32 node) const
+{
+    Ast::BitSet res( d_elems.size() );
+    res.setBit( d_elemOf[node] );
+    return res;
+}
+
+Ast::NodeSet FirstFollowSet::toNodeSet(const Ast::BitSet& bits) const
+{
+    Ast::NodeSet res;
+    for( quint32 e = bits.nextBit(0); e != Ast::BitSet::Invalid; e = bits.nextBit(e + 1) )
+        res << d_flat->getNode( d_elems[e] );
+    return res;
+}
+
+Ast::NodeRefSet FirstFollowSet::toRefSet(const Ast::BitSet& bits) const
+{
+    Ast::NodeRefSet res;
+    for( quint32 e = bits.nextBit(0); e != Ast::BitSet::Invalid; e = bits.nextBit(e + 1) )
+        res << Ast::NodeRef( d_flat->getNode( d_elems[e] ) );
+    return res;
+}
+
+Ast::BitSet FirstFollowSet::toTerms(const Ast::BitSet& bits) const
+{
+    Ast::BitSet res( d_syn->getTermCount() );
+    for( quint32 e = bits.nextBit(0); e != Ast::BitSet::Invalid; e = bits.nextBit(e + 1) )
+    {
+        const quint32 id = d_flat->getSymId( d_elems[e] );
+        if( d_syn->isTermId(id) )
+            res.setBit(id);
+    }
+    return res;
+}
+
+Ast::BitSet FirstFollowSet::toTerms(const Ast::NodeSet& nodes) const
+{
+    Ast::BitSet res( d_syn->getTermCount() );
+    foreach( const Ast::Node* n, nodes )
+    {
+        const quint32 id = d_syn->getSymId(n);
+        if( d_syn->isTermId(id) )
+            res.setBit(id);
+    }
+    return res;
+}
+
+void FirstFollowSet::numberElements()
+{
+    // the elements are the nodes which can appear in a FIRST set
+    d_elemOf.fill( FlatSyntax::Invalid, d_flat->getNodeCount() );
+    for( quint32 i = 0; i < d_flat->getNodeCount(); i++ )
+    {
+        if( d_flat->getType(i) == Ast::Node::Terminal ||
+                ( d_flat->getType(i) == Ast::Node::Nonterminal &&
+                  ( d_includeNts || d_flat->getTarget(i) == FlatSyntax::Invalid ) ) )
+        {
+            d_elemOf[i] = d_elems.size();
+            d_elems.append(i);
+        }
+    }
+    // the leafs representing the symbols of the LL(k) sets
+    d_symLeaf.fill( 0, d_syn->getSymIdCount() );
+    for( quint32 i = 0; i < d_flat->getNodeCount(); i++ )
+    {
+        const quint32 id = d_flat->getSymId(i);
+        if( ( d_flat->getType(i) == Ast::Node::Terminal || ( d_flat->getType(i) == Ast::Node::Nonterminal &&
+                d_flat->getTarget(i) == FlatSyntax::Invalid ) ) && id < quint32(d_symLeaf.size()) && d_symLeaf[id] == 0 )
+            d_symLeaf[id] = d_flat->getNode(i);
+    }
 }
 
 Ast::NodeSet FirstFollowSet::calculateFirstSet(const Ast::Node* node) const
@@ -140,7 +388,9 @@ Ast::NodeSet FirstFollowSet::calculateFirstSet(const Ast::Node* node) const
                 res << node; // unechtes Terminal
             else
             {
-                res = d_first[node->d_def->d_node];
+                const quint32 i = indexOf( node->d_def->d_node );
+                if( i != FlatSyntax::Invalid )
+                    res = toNodeSet( d_first[i] );
                 if( d_includeNts )
                     res += node;
             }
@@ -151,32 +401,82 @@ Ast::NodeSet FirstFollowSet::calculateFirstSet(const Ast::Node* node) const
         Q_ASSERT(false); // wir können nie hier landen wegen oberstem node->ignore
         break;
     }
-    // Cache nützt während First-Kalkulation noch nichts,
-    // da während der Kalkulation über alle Definitions auch auf Ebene der Nodes einiges ändert.
     return res;
 }
 
-void FirstFollowSet::calculateFirstSets()
+Ast::BitSet FirstFollowSet::calculateFirstSet(quint32 node) const
 {
-    // Implement algorithm by a fixed-point iteration
+    // same as calculateFirstSet(const Ast::Node*) for the nodes of the flat syntax
+    if( d_flat->hasFlag( node, FlatSyntax::Ignore ) )
+        return Ast::BitSet();
 
-    bool changed;
-    do
+    Ast::BitSet res;
+    const quint32 end = d_flat->getFirstChild(node) + d_flat->getChildCount(node);
+    switch( d_flat->getType(node) )
     {
-        changed = false;
-        foreach( Ast::Definition* d, d_syn->getOrderedDefs() )
+    case Ast::Node::Terminal:
+        res = leaf(node);
+        break;
+    case Ast::Node::Alternative:
+        for( quint32 i = d_flat->getFirstChild(node); i < end; i++ )
         {
-            if( d->d_node == 0 // pseudoterminal, wird nicht hier behandelt, sondern beim NT, das darauf zeigt
-                    || d->doIgnore() )
+            if( d_flat->hasFlag( i, FlatSyntax::Ignore ) )
                 continue;
-            Ast::NodeSet newValue = calculateFirstSet(d->d_node);
-            if( newValue != d_first[d->d_node] )
-            {
-                d_first[d->d_node] = newValue;
-                changed = true;
-            }
+            res.unite( calculateFirstSet(i) );
+        }
+        break;
+    case Ast::Node::Sequence:
+        for( quint32 i = d_flat->getFirstChild(node); i < end; i++ )
+        {
+            if( d_flat->hasFlag( i, FlatSyntax::Ignore ) )
+                continue;
+            res.unite( calculateFirstSet(i) );
+            if( !d_flat->hasFlag( i, FlatSyntax::Nullable ) )
+                break;
+        }
+        break;
+    case Ast::Node::Nonterminal:
+        if( d_flat->getTarget(node) == FlatSyntax::Invalid )
+            res = leaf(node); // unechtes Terminal
+        else
+        {
+            res = d_first[d_flat->getTarget(node)];
+            if( d_includeNts )
+                res.unite( leaf(node) );
         }
-    }while( changed );
+        break;
+    default:
+        break;
+    }
+    // Cache nützt während First-Kalkulation noch nichts,
+    // da während der Kalkulation über alle Definitions auch auf Ebene der Nodes einiges ändert.
+    return res;
+}
+
+void FirstFollowSet::calculateFirstSets()
+{
+    // The definitions are evaluated in reverse topological order of the strongly connected components of
+    // the "can start with" graph, so the definitions a definition starts with are final when it is evaluated;
+    // only the components with cycles are iterated to a fixed point.
+    const FlatSyntax& flat = *d_flat;
+    const FlatSyntax::Graph graph = flat.calcStartGraph();
+    const FlatSyntax::Components comps = FlatSyntax::findComponents( graph );
+    QVector<Ast::BitSet> sets( flat.getNodeCount() );
+    QVector<Ast::BitSet> stored( flat.getDefCount() );
+    EbnfProfiler::addIterations("calculateFirstSets");
+    foreach( const QVector<quint32>& comp, comps )
+    {
+        const bool cyclic = comp.size() > 1 || graph[comp.first()].contains( comp.first() );
+        bool changed;
+        do
+        {
+            changed = false;
+            foreach( quint32 d, comp )
+                changed |= calculateFirstSets( d, sets, stored );
+            if( cyclic && changed )
+                EbnfProfiler::addIterations("calculateFirstSets");
+        }while( cyclic && changed );
+    }
 
     // The computation will terminate because
     // - the variables are changed monotonically (using set union)
@@ -187,146 +487,567 @@ void FirstFollowSet::calculateFirstSets()
     // für den rekursiven galt:
     // 2019-02-05 Output des Algorithmus mit Coco/R verglichen. Stimmt überein.
 
-    // dieser algo brauch 21 ms.
-    // der rekursive brauchte 20 ms.
+    // Nonterminals not in start position may refer to definitions evaluated later; with all definitions
+    // final, one more round yields the sets getFirstNodeSet would calculate on demand.
+    for( quint32 d = 0; d < flat.getDefCount(); d++ )
+        calculateFirstSets( d, sets, stored );
+    d_first = sets;
+    d_firstKnown = QBitArray( flat.getNodeCount() );
+    for( quint32 d = 0; d < flat.getDefCount(); d++ )
+    {
+        if( flat.getRoot(d) == FlatSyntax::Invalid || flat.hasDefFlag( d, FlatSyntax::Ignore ) )
+            continue;
+        for( quint32 i = flat.getRoot(d); i < flat.getEnd(d); i++ )
+            d_firstKnown.setBit(i);
+    }
 }
 
-
-void FirstFollowSet::calculateFollowSets()
+bool FirstFollowSet::calculateFirstSets(quint32 def, QVector<Ast::BitSet>& sets, QVector<Ast::BitSet>& stored) const
 {
-    bool changed;
-    do
+    // the sets of all nodes of a definition are computed in one reverse sweep over its index range, i.e.
+    // children before their parent; a Nonterminal takes the value currently stored for its definition.
+    const FlatSyntax& flat = *d_flat;
+    const quint32 root = flat.getRoot(def);
+    if( root == FlatSyntax::Invalid // pseudoterminal, wird nicht hier behandelt, sondern beim NT, das darauf zeigt
+            || flat.hasDefFlag( def, FlatSyntax::Ignore ) )
+        return false;
+    for( quint32 i = flat.getEnd(def); i-- > root; )
     {
-        changed = false;
-        for( int i = 0; i < d_syn->getOrderedDefs().size(); i++ )
+        Ast::BitSet res;
+        if( flat.hasFlag( i, FlatSyntax::Ignore ) )
         {
-            Ast::Definition* def = d_syn->getOrderedDefs()[i];
-            if( def->d_node == 0 || def->doIgnore() )
-                continue;
-            //qDebug() << def->d_tok.d_val;
-            //changed |= calculateFollowSet(d);
-            changed |= calculateFollowSet2(def->d_node, false);
+            sets[i] = res;
+            continue;
         }
-    }while( changed );
-
+        const quint32 end = flat.getFirstChild(i) + flat.getChildCount(i);
+        switch( flat.getType(i) )
+        {
+        case Ast::Node::Terminal:
+            res = leaf(i);
+            break;
+        case Ast::Node::Alternative:
+            for( quint32 j = flat.getFirstChild(i); j < end; j++ )
+            {
+                if( flat.hasFlag( j, FlatSyntax::Ignore ) )
+                    continue;
+                // eine Alternative kann in jedes der Elemente verzweigen, also ist der Union das First Set
+                res.unite( sets[j] );
+            }
+            break;
+        case Ast::Node::Sequence:
+            for( quint32 j = flat.getFirstChild(i); j < end; j++ )
+            {
+                if( flat.hasFlag( j, FlatSyntax::Ignore ) )
+                    continue;
+                res.unite( sets[j] );
+                if( !flat.hasFlag( j, FlatSyntax::Nullable ) )
+                    break;
+            }
+            break;
+        case Ast::Node::Nonterminal:
+            if( flat.getTarget(i) == FlatSyntax::Invalid )
+                res = leaf(i); // unechtes Terminal
+            else
+            {
+                res = stored[flat.getDef(i)];
+                if( d_includeNts )
+                    res.unite( leaf(i) );
+            }
+            break;
+        default:
+            break;
+        }
+        sets[i] = res;
+    }
+    if( sets[root] != stored[def] )
+    {
+        stored[def] = sets[root];
+        return true;
+    }
+    return false;
 }
 
-static inline bool isNt( const Ast::Node* node )
+void FirstFollowSet::calculateFollowSets()
 {
-    return node->d_type == Ast::Node::Nonterminal ||
-            node->d_type == Ast::Node::Sequence ||
-            node->d_type == Ast::Node::Alternative;
-}
+    // The constraints of the grammar are collected once: constant parts (FIRST sets of successors and of
+    // repetitions) are united directly, inclusions of one follow set in another become edges. A worklist
+    // then only propagates along the edges of follow sets which actually grew.
+    const quint32 count = d_flat->getNodeCount() + 1;
+    d_follow.fill( Ast::BitSet(), count );
+    FlatSyntax::Graph edges( count );
+    for( quint32 d = 0; d < d_flat->getDefCount(); d++ )
+    {
+        if( d_flat->getRoot(d) == FlatSyntax::Invalid || d_flat->hasDefFlag( d, FlatSyntax::Ignore ) )
+            continue;
+        calculateFollowSet2( d_flat->getRoot(d), edges );
+    }
 
-static bool add(FirstFollowSet::Lookup& lkp, const Ast::Node* node, const Ast::NodeSet& rhs )
-{
-    if( node->d_def )
+    // Components of the edge graph are processed sources first, so a follow set is complete before it is
+    // propagated, except within cycles, where a worklist is used.
+    const FlatSyntax::Components comps = FlatSyntax::findComponents( edges );
+    QVector<quint32> compOf( count );
+    for( int c = 0; c < comps.size(); c++ )
     {
-        Q_ASSERT(node->d_type == Ast::Node::Nonterminal );
-        node = node->d_def->d_node;
+        foreach( quint32 i, comps[c] )
+            compOf[i] = c;
     }
-    Ast::NodeSet& orig = lkp[node];
-    Ast::NodeSet lhs = orig;
-    lhs += rhs;
-    bool changed = false;
-    if( orig != lhs )
+    QVector<quint32> todo;
+    QBitArray queued( count );
+    quint32 steps = 0;
+    for( int c = comps.size() - 1; c >= 0; c-- )
     {
-        changed = true;
-        orig = lhs;
+        foreach( quint32 i, comps[c] )
+        {
+            if( !edges[i].isEmpty() && !d_follow[i].isEmpty() )
+            {
+                todo.append(i);
+                queued.setBit(i);
+            }
+        }
+        while( !todo.isEmpty() )
+        {
+            const quint32 from = todo.back();
+            todo.pop_back();
+            queued.clearBit(from);
+            steps++;
+            const Ast::BitSet follow = d_follow[from];
+            foreach( quint32 to, edges[from] )
+            {
+                if( d_follow[to].unite( follow ) && compOf[to] == quint32(c) && !queued.testBit(to) )
+                {
+                    todo.append(to);
+                    queued.setBit(to);
+                }
+            }
+        }
     }
-    return changed;
-#if 0
-    Ast::NodeSet lhs = lkp[node];
-    lhs += rhs;
-    bool changed = false;
-    if( lhs != lkp[node] )
+    EbnfProfiler::addIterations("calculateFollowSets", steps );
+}
+
+quint32 FirstFollowSet::followKey(quint32 node) const
+{
+    // a Nonterminal adds to the follow set of the root of its definition, which is key 0 for pseudoterminals
+    if( d_flat->getDef(node) != FlatSyntax::Invalid )
     {
-        changed = true;
-        lkp[node] = lhs;
+        Q_ASSERT( d_flat->getType(node) == Ast::Node::Nonterminal );
+        if( d_flat->getTarget(node) != FlatSyntax::Invalid )
+            return d_flat->getTarget(node);
+        else
+            return d_flat->getNodeCount();
     }
-    return changed;
-#endif
+    return node;
+}
+
+static inline bool isNt( quint8 type )
+{
+    return type == Ast::Node::Nonterminal ||
+            type == Ast::Node::Sequence ||
+            type == Ast::Node::Alternative;
 }
 
-bool FirstFollowSet::calculateFollowSet2(const Ast::Node* node, bool addRepetitions )
+void FirstFollowSet::calculateFollowSet2(quint32 node, FlatSyntax::Graph& edges)
 {
     // Dieser Algorithmus produziert ein identisches Follow-Set mit Coco/R wenn addRepetitions
     // habe vollständigen 1:1-Vergleich gemacht.
 
-    if( node == 0 || node->doIgnore() )
-        return false;
+    // edges[a] contains b if the follow set of a is part of the follow set of b
+
+    const FlatSyntax& flat = *d_flat;
+    if( flat.hasFlag( node, FlatSyntax::Ignore ) )
+        return;
 
     // NT ---
     //      NT | T | SEQ | ALT
     //               SEQ ---
     //                     NT | T | SEQ | ALT
 
-    bool changed = false;
-    switch( node->d_type )
+    switch( flat.getType(node) )
     {
     case Ast::Node::Nonterminal:
-        if( node == node->d_owner->d_node )
+        if( node == flat.getRoot( flat.getOwner(node) ) )
         {
             // Spezialfall, wenn Definition nur ein NT enthält
-            Ast::NodeSet follow = d_follow[node];
             // vereine das Follow Set dieses Nonterminals mit demjenigen dieser Production, in der sich das
             // Nonterminal gerade befindet
-            changed |= add( d_follow, node, follow );
+            edges[node].append( followKey(node) );
             // Wiederholung wird weiter unten behandelt
         }
         break;
     case Ast::Node::Alternative:
     case Ast::Node::Sequence:
-        for( int i = 0; i < node->d_subs.size(); i++ )
         {
-            // gehe durch alle Elemente der Sequence oder Alternative
-            Ast::Node* a = node->d_subs[i];
-            if( a->doIgnore() || !isNt(a))
-                continue;
-            // hier werden nur die Elemente von Seq und Alt betrachtet, die Nonterminals sind.
-            // Vorsicht: da wir in einer EBNF sind, ist jede Sequence und Alternative selber
-            // eine Production bzw. Nonterminal! Siehe https://stackoverflow.com/questions/2466484/converting-ebnf-to-bnf
-            Ast::NodeSet follow;
-            bool foundNn = false;
-            if( node->d_type == Ast::Node::Sequence )
-                for( int j = i + 1; j < node->d_subs.size(); j++ )
-                {
-                    // Berechne im Falle einer Sequence das Follow Set ab dem aktuellen NT.
-                    const Ast::Node* b = node->d_subs[j];
-                    if( b->doIgnore() )
-                        continue;
-                    const Ast::NodeSet first = getFirstNodeSet(b);
-                    follow += first;
-                    if( !b->isNullable() )
+            const quint32 end = flat.getFirstChild(node) + flat.getChildCount(node);
+            for( quint32 a = flat.getFirstChild(node); a < end; a++ )
+            {
+                // gehe durch alle Elemente der Sequence oder Alternative
+                if( flat.hasFlag( a, FlatSyntax::Ignore ) || !isNt( flat.getType(a) ) )
+                    continue;
+                // hier werden nur die Elemente von Seq und Alt betrachtet, die Nonterminals sind.
+                // Vorsicht: da wir in einer EBNF sind, ist jede Sequence und Alternative selber
+                // eine Production bzw. Nonterminal! Siehe https://stackoverflow.com/questions/2466484/converting-ebnf-to-bnf
+                Ast::BitSet follow;
+                bool foundNn = false;
+                if( flat.getType(node) == Ast::Node::Sequence )
+                    for( quint32 b = a + 1; b < end; b++ )
                     {
-                        // Jedes nullable b + das erste non-nullable b gehören zum Follow Set
-                        foundNn = true;
-                        break;
+                        // Berechne im Falle einer Sequence das Follow Set ab dem aktuellen NT.
+                        if( flat.hasFlag( b, FlatSyntax::Ignore ) )
+                            continue;
+                        follow.unite( getFirstBits(b) );
+                        if( !flat.hasFlag( b, FlatSyntax::Nullable ) )
+                        {
+                            // Jedes nullable b + das erste non-nullable b gehören zum Follow Set
+                            foundNn = true;
+                            break;
+                        }
                     }
+                if( !foundNn )
+                {
+                    // wenn es sich um ein Element einer Alternative handelt oder in einer Sequence alles bis ans
+                    // Ende nullable war, wird das übergeordnete Follow Set runtergeholt
+                    edges[node].append( followKey(a) );
                 }
-            if( !foundNn )
-            {
-                // wenn es sich um ein Element einer Alternative handelt oder in einer Sequence alles bis ans
-                // Ende nullable war, wird das übergeordnete Follow Set runtergeholt
-                const Ast::NodeSet outer = d_follow[node];
-                follow += outer;
-            }
-            changed |= add( d_follow, a, follow );
+                d_follow[followKey(a)].unite( follow );
 
-            // go down
-            changed |= calculateFollowSet2(a,addRepetitions);
+                // go down
+                calculateFollowSet2( a, edges );
+            }
         }
         break;
     default:
         break;
     }
     // das muss hier auf Ebene von node gemacht werden, da sonst Definition.d_node nicht berücksichtigt wird.
-    if( isNt(node) && node->d_quant == Ast::Node::ZeroOrMore ) //  && addRepetitions )
+    if( isNt( flat.getType(node) ) && flat.getQuant(node) == Ast::Node::ZeroOrMore )
     {
         // Wenn das Element wiederholt wird, erscheint auch sein eigenes First-Set als Teil des Follow-Sets
-        changed |= add( d_follow, node, getFirstNodeSet(node) );
+        d_follow[followKey(node)].unite( getFirstBits(node) );
         // NOTE: wenn eine Alternative wiederholt, kann jedes Element potentiell vorkommen, es muss also das first
         // von jedem Sub ins follow der Alternative. Das wird von getFirstSet(Alternative) bereits berücksichtigt
     }
+}
+
+static inline quint32 endBit( int len )
+{
+    // LlkSet::d_ends only has the lengths below k <= 32
+    return len < 32 ? quint32(1) << len : 0;
+}
+
+bool FirstFollowSet::LlkSet::unite(const LlkSet& rhs)
+{
+    bool changed = ( d_ends | rhs.d_ends ) != d_ends;
+    d_ends |= rhs.d_ends;
+    if( d_pos.size() < rhs.d_pos.size() )
+        d_pos.resize( rhs.d_pos.size() );
+    for( int i = 0; i < rhs.d_pos.size(); i++ )
+        changed |= d_pos[i].unite( rhs.d_pos[i] );
     return changed;
 }
+
+bool FirstFollowSet::LlkSet::intersects(const LlkSet& rhs) const
+{
+    // Only sequences ending before the first position without common symbols can be in both sets;
+    // these are candidates if both sets have sequences of the same length there.
+    int common = 0;
+    while( common < d_pos.size() && common < rhs.d_pos.size() && d_pos[common].intersects( rhs.d_pos[common] ) )
+        common++;
+    if( common == d_pos.size() && common == rhs.d_pos.size() )
+        return true;
+    const quint32 ends = d_ends & rhs.d_ends;
+    for( int i = 0; i <= common; i++ )
+    {
+        if( ends & endBit(i) )
+            return true;
+    }
+    return false;
+}
+
+FirstFollowSet::LlkSet FirstFollowSet::getLlkFirstSet(const Ast::Node* node, quint16 k) const
+{
+    QMutexLocker lock( d_frozen ? 0 : &d_lock );
+    LlkState temp;
+    return llkFirstOf( node, llkState(k,temp) );
+}
+
+FirstFollowSet::LlkSet FirstFollowSet::getLlkFollowSet(const Ast::Node* node, quint16 k) const
+{
+    QMutexLocker lock( d_frozen ? 0 : &d_lock );
+    LlkState temp;
+    return llkFollowOf( node, llkState(k,temp) );
+}
+
+FirstFollowSet::LlkSet FirstFollowSet::getLlkEntrySet(const Ast::Node* node, quint16 k) const
+{
+    QMutexLocker lock( d_frozen ? 0 : &d_lock );
+    LlkState temp;
+    LlkState& s = llkState(k,temp);
+    LlkSet res = llkFirstOf( node, s, true );
+    if( node != 0 && node->d_quant == Ast::Node::ZeroOrMore && res.isOpen() )
+        llkConcat( res, llkFirstOf( node, s ), s.d_k );
+    if( res.isOpen() )
+        llkConcat( res, llkFollowOf( node, s ), s.d_k );
+    return res;
+}
+
+FirstFollowSet::LlkState& FirstFollowSet::llkState(quint16 k, LlkState& temp) const
+{
+    k = qBound( quint16(1), k, quint16(32) ); // see LlkSet::d_ends
+    if( d_frozen )
+    {
+        // the frozen states are only read; a k not calculated before freeze is calculated for this query only
+        QHash<quint16,LlkState>::const_iterator i = d_llk.constFind(k);
+        if( i != d_llk.constEnd() )
+            return const_cast<LlkState&>( i.value() );
+        temp = LlkState(k);
+        return temp;
+    }
+    FirstFollowSet* set = const_cast<FirstFollowSet*>(this);
+    QHash<quint16,LlkState>::iterator i = set->d_llk.find(k);
+    if( i == set->d_llk.end() )
+        i = set->d_llk.insert( k, LlkState(k) );
+    return i.value();
+}
+
+FirstFollowSet::LlkSet FirstFollowSet::llkFirst(const Ast::Definition* d, LlkState& s) const
+{
+    if( !s.d_firstDone && !s.d_inFirst )
+        calcLlkFirstSets( s );
+    QHash<const Ast::Definition*,LlkSet>::const_iterator i = s.d_first.constFind(d);
+    if( i != s.d_first.constEnd() )
+        return i.value();
+    LlkSet none( s.d_k );
+    none.d_ends = 0;
+    return none;
+}
+
+void FirstFollowSet::calcLlkFirstSets(LlkState& s) const
+{
+    // Same order as in calculateFirstSets, but along all references of a definition since the k symbols
+    // reach beyond its start; during the iteration llkFirst returns the value reached so far.
+    FlatSyntax::Graph refs( d_flat->getDefCount() );
+    for( quint32 d = 0; d < d_flat->getDefCount(); d++ )
+    {
+        if( d_flat->getRoot(d) == FlatSyntax::Invalid )
+            continue;
+        for( quint32 i = d_flat->getRoot(d); i < d_flat->getEnd(d); i++ )
+        {
+            const quint32 to = d_flat->getDef(i);
+            if( d_flat->getTarget(i) != FlatSyntax::Invalid && !refs[d].contains(to) )
+                refs[d].append( to );
+        }
+    }
+    s.d_inFirst = true;
+    foreach( const QVector<quint32>& comp, FlatSyntax::findComponents( refs ) )
+    {
+        const bool cyclic = comp.size() > 1 || refs[comp.first()].contains( comp.first() );
+        bool changed;
+        do
+        {
+            EbnfProfiler::addIterations("calcLlkFirstSets");
+            changed = false;
+            foreach( quint32 d, comp )
+            {
+                if( d_flat->getRoot(d) == FlatSyntax::Invalid )
+                    continue;
+                const Ast::Definition* def = d_flat->getDefinition(d);
+                const LlkSet res = llkFirstOf( def->d_node, s );
+                QHash<const Ast::Definition*,LlkSet>::iterator i = s.d_first.find(def);
+                if( i == s.d_first.end() )
+                {
+                    s.d_first.insert( def, res );
+                    changed = true;
+                }else if( i.value().unite( res ) )
+                    changed = true;
+            }
+        }while( changed && cyclic );
+    }
+    s.d_inFirst = false;
+    s.d_firstDone = true;
+}
+
+FirstFollowSet::LlkSet FirstFollowSet::llkFollow(const Ast::Definition* d, LlkState& s) const
+{
+    if( !s.d_followDone && !s.d_inFollow )
+        calcLlkFollowSets( s );
+    QHash<const Ast::Definition*,LlkSet>::const_iterator i = s.d_follow.constFind(d);
+    if( i != s.d_follow.constEnd() )
+        return i.value();
+    LlkSet none( s.d_k );
+    none.d_ends = 0;
+    return none;
+}
+
+void FirstFollowSet::calcLlkFollowSets(LlkState& s) const
+{
+    // the follow of a definition depends on the follow of the definitions using it
+    FlatSyntax::Graph users( d_flat->getDefCount() );
+    for( quint32 i = 0; i < d_flat->getNodeCount(); i++ )
+    {
+        const quint32 d = d_flat->getDef(i);
+        if( d != FlatSyntax::Invalid && !d_flat->hasFlag( i, FlatSyntax::Ignore ) &&
+                !users[d].contains( d_flat->getOwner(i) ) )
+            users[d].append( d_flat->getOwner(i) );
+    }
+    s.d_inFollow = true;
+    foreach( const QVector<quint32>& comp, FlatSyntax::findComponents( users ) )
+    {
+        const bool cyclic = comp.size() > 1 || users[comp.first()].contains( comp.first() );
+        bool changed;
+        do
+        {
+            EbnfProfiler::addIterations("calcLlkFollowSets");
+            changed = false;
+            foreach( quint32 d, comp )
+                changed |= calcLlkFollowSet( d_flat->getDefinition(d), s );
+        }while( changed && cyclic );
+    }
+    s.d_inFollow = false;
+    s.d_followDone = true;
+}
+
+bool FirstFollowSet::calcLlkFollowSet(const Ast::Definition* d, LlkState& s) const
+{
+    LlkSet res( s.d_k );
+    res.d_ends = 0;
+    bool used = false;
+    foreach( const Ast::Node* use, d->d_usedBy )
+    {
+        if( use->doIgnore() )
+            continue;
+        used = true;
+        LlkSet sub( s.d_k );
+        if( use->d_quant == Ast::Node::ZeroOrMore )
+            sub = llkFirstOf( use, s ); // the next repetition
+        if( sub.isOpen() )
+            llkConcat( sub, llkFollowOf( use, s ), s.d_k );
+        res.unite( sub );
+    }
+    if( !used )
+        res.d_ends |= 1; // the input can end after a definition nobody uses, e.g. the start production
+    QHash<const Ast::Definition*,LlkSet>::iterator i = s.d_follow.find(d);
+    if( i == s.d_follow.end() )
+    {
+        s.d_follow.insert( d, res );
+        return true;
+    }
+    return i.value().unite( res );
+}
+
+FirstFollowSet::LlkSet FirstFollowSet::llkFirstOf(const Ast::Node* node, LlkState& s, bool once) const
+{
+    LlkSet res( s.d_k );
+    if( node == 0 || node->doIgnore() )
+        return res;
+    // outside of an iteration round all definitions used are final, and so is the result
+    const bool final = !once && !s.d_inFirst;
+    if( final )
+    {
+        QHash<const Ast::Node*,LlkSet>::const_iterator i = s.d_nodeFirst.constFind(node);
+        if( i != s.d_nodeFirst.constEnd() )
+            return i.value();
+    }
+    llkAppend( res, node, s );
+    const quint8 quant = once ? quint8(Ast::Node::One) : quint8(node->d_quant);
+    if( quant == Ast::Node::ZeroOrOne )
+        res.d_ends |= 1;
+    else if( quant == Ast::Node::ZeroOrMore )
+    {
+        // rep = empty | node rep
+        const LlkSet body = res;
+        LlkSet rep( s.d_k );
+        LlkSet next;
+        do
+        {
+            next = body;
+            llkConcat( next, rep, s.d_k );
+        }while( rep.unite( next ) );
+        res = rep;
+    }
+    if( final && !s.d_frozen )
+        s.d_nodeFirst.insert( node, res );
+    return res;
+}
+
+void FirstFollowSet::llkAppend(LlkSet& res, const Ast::Node* node, LlkState& s) const
+{
+    // res is the empty sequence; appends the sequences of one pass through the node
+    switch( node->d_type )
+    {
+    case Ast::Node::Terminal:
+    case Ast::Node::Nonterminal:
+        if( node->d_type == Ast::Node::Nonterminal && node->d_def && node->d_def->d_node )
+            res = llkFirst( node->d_def, s );
+        else
+        {
+            res.d_pos[0] = Ast::BitSet( d_syn->getSymIdCount() );
+            const quint32 id = d_syn->getSymId(node);
+            if( id < d_syn->getSymIdCount() )
+                res.d_pos[0].setBit( id );
+            res.d_ends = s.d_k > 1 ? 2 : 0;
+        }
+        break;
+    case Ast::Node::Sequence:
+        for( int i = 0; i < node->d_subs.size() && res.isOpen(); i++ )
+        {
+            if( !node->d_subs[i]->doIgnore() )
+                llkConcat( res, llkFirstOf( node->d_subs[i], s ), s.d_k );
+        }
+        break;
+    case Ast::Node::Alternative:
+        {
+            LlkSet alts( s.d_k );
+            alts.d_ends = 0;
+            bool any = false;
+            foreach( Ast::Node* sub, node->d_subs )
+            {
+                if( sub->doIgnore() )
+                    continue;
+                alts.unite( llkFirstOf( sub, s ) );
+                any = true;
+            }
+            if( any )
+                res = alts;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+FirstFollowSet::LlkSet FirstFollowSet::llkFollowOf(const Ast::Node* node, LlkState& s) const
+{
+    QHash<const Ast::Node*,LlkSet>::const_iterator i = s.d_nodeFollow.constFind(node);
+    if( i != s.d_nodeFollow.constEnd() )
+        return i.value();
+    // the rest of the enclosing sequences up to the definition, then the follow of the definition
+    LlkSet res( s.d_k );
+    if( node == 0 )
+        return res;
+    Ast::FollowCursor next( node );
+    for( ; !next.atEnd() && res.isOpen(); ++next )
+    {
+        if( next.isRepeat() || !(*next)->doIgnore() )
+            llkConcat( res, llkFirstOf( *next, s ), s.d_k );
+    }
+    const Ast::Node* me = next.getTop();
+    if( me->d_owner && res.isOpen() )
+        llkConcat( res, llkFollow( me->d_owner, s ), s.d_k );
+    if( !s.d_inFirst && !s.d_inFollow && !s.d_frozen )
+        s.d_nodeFollow.insert( node, res );
+    return res;
+}
+
+void FirstFollowSet::llkConcat(LlkSet& lhs, const LlkSet& rhs, quint16 k)
+{
+    // each sequence of lhs shorter than k continues with each sequence of rhs
+    const quint32 ends = lhs.d_ends;
+    lhs.d_ends = 0;
+    for( quint16 j = 0; j < k; j++ )
+    {
+        if( !( ends & endBit(j) ) )
+            continue;
+        for( quint16 i = 0; i + j < k && i < rhs.d_pos.size(); i++ )
+            lhs.d_pos[i + j].unite( rhs.d_pos[i] );
+        lhs.d_ends |= ( rhs.d_ends << j ) & ( endBit(k) - 1 ); // k = 32 wraps to all bits
+    }
+}
@@ -21,12 +21,22 @@
 */
 
 #include <QObject>
+#include <QBitArray>
+#include <QMutex>
 #include "EbnfSyntax.h"
 
 class FirstFollowSet : public QObject
 {
 public:
-    typedef QHash<const Ast::Node*, Ast::NodeSet> Lookup;
+    // queries answered from the caches of getFirstNodeSet, getFirstSet, getFollowNodeSet and getFollowSet
+    struct CacheStats
+    {
+        enum Kind { FirstNodes, FirstRefs, FollowNodes, FollowRefs, MaxKind };
+        static const char* s_kindName[];
+        quint32 d_hits[MaxKind];
+        quint32 d_misses[MaxKind];
+        CacheStats() { for( int i = 0; i < MaxKind; i++ ) d_hits[i] = d_misses[i] = 0; }
+    };
 
     explicit FirstFollowSet(QObject *parent = 0);
 
@@ -41,18 +51,99 @@ public:
     Ast::NodeSet getFollowNodeSet( const Ast::Node*) const;
     Ast::NodeRefSet getFollowSet( const Ast::Definition*) const;
     Ast::NodeRefSet getFollowSet( const Ast::Node*) const;
+    // same as getFirstSet and getFollowSet, but over the dense terminal ids of EbnfSyntax::getSymId
+    Ast::BitSet getFirstTerms( const Ast::Node* ) const;
+    Ast::BitSet getFollowTerms( const Ast::Node* ) const;
+    const CacheStats& getCacheStats() const { return d_stats; }
+    // Completes the FIRST sets of all nodes and the LL(k) sets for the given k and the ones calculated so far;
+    // afterwards, until thaw, setSyntax or clear, the queries only read the caches and can come from several
+    // threads without locking. Results not in the caches are calculated again for each query and are not counted
+    // in the CacheStats.
+    void freeze( const QList<quint16>& ks = QList<quint16>() );
+    void thaw();
+    bool isFrozen() const { return d_frozen; }
+
+    // LL(k) lookahead approximated by position, i.e. the symbols (EbnfSyntax::getSymId) which can appear at
+    // position 0..k-1 and the lengths below k at which the input can end; the sets are computed once per k
+    struct LlkSet
+    {
+        QVector<Ast::BitSet> d_pos;
+        quint32 d_ends; // bit i: a sequence of length i
+        LlkSet( quint16 k = 0 ):d_pos(k),d_ends(1){} // the empty sequence
+        bool unite( const LlkSet& ); // returns true if something was added
+        // a sequence could start both; only a sound prefilter, since the symbols are kept by position and not
+        // by sequence: false means no common sequence, true still needs the exact check by LlkDfa
+        bool intersects( const LlkSet& ) const;
+        bool isOpen() const { return d_ends != 0; } // there are sequences shorter than k
+    };
+    LlkSet getLlkFirstSet( const Ast::Node*, quint16 k ) const; // the node including its quantifier
+    LlkSet getLlkFollowSet( const Ast::Node*, quint16 k ) const;
+    LlkSet getLlkEntrySet( const Ast::Node*, quint16 k ) const; // at least one pass through the node and the follow
+    const Ast::Node* getLlkSymbol( quint32 id ) const { return d_symLeaf.value(id); } // a leaf with the symbol id
 protected:
     Ast::NodeSet calculateFirstSet( const Ast::Node* ) const;
+    Ast::BitSet calculateFirstSet( quint32 node ) const;
+    quint32 indexOf( const Ast::Node* ) const;
+    static const Ast::Node* lookupKey( const Ast::Node* );
+    Ast::BitSet getFirstBits( quint32 node, bool cache = true ) const;
+    Ast::BitSet getFollowBits( const Ast::Node* ) const;
+    Ast::BitSet leaf( quint32 node ) const;
+    quint32 followKey( quint32 node ) const;
+    Ast::NodeSet toNodeSet( const Ast::BitSet& ) const;
+    Ast::NodeRefSet toRefSet( const Ast::BitSet& ) const;
+    Ast::BitSet toTerms( const Ast::BitSet& ) const;
+    Ast::BitSet toTerms( const Ast::NodeSet& ) const;
+    void numberElements();
     void calculateFirstSets();
+    bool calculateFirstSets( quint32 def, QVector<Ast::BitSet>& sets, QVector<Ast::BitSet>& stored ) const;
     void calculateFollowSets();
-    bool calculateFollowSet2(const Ast::Node* , bool addRepetitions = true);
+    void calculateFollowSet2( quint32 node, FlatSyntax::Graph& );
     bool calculateFollowSet( const Ast::Definition* );
+    struct LlkState
+    {
+        quint16 d_k;
+        QHash<const Ast::Definition*,LlkSet> d_first;
+        QHash<const Ast::Definition*,LlkSet> d_follow;
+        QHash<const Ast::Node*,LlkSet> d_nodeFirst;
+        QHash<const Ast::Node*,LlkSet> d_nodeFollow;
+        bool d_firstDone, d_followDone, d_inFirst, d_inFollow, d_frozen;
+        LlkState( quint16 k = 0 ):d_k(k),d_firstDone(false),d_followDone(false),d_inFirst(false),d_inFollow(false),
+            d_frozen(false){}
+    };
+    LlkState& llkState( quint16 k, LlkState& temp ) const;
+    LlkSet llkFirst( const Ast::Definition*, LlkState& ) const;
+    LlkSet llkFollow( const Ast::Definition*, LlkState& ) const;
+    void calcLlkFirstSets( LlkState& ) const;
+    void calcLlkFollowSets( LlkState& ) const;
+    bool calcLlkFollowSet( const Ast::Definition*, LlkState& ) const;
+    LlkSet llkFirstOf( const Ast::Node*, LlkState&, bool once = false ) const;
+    LlkSet llkFollowOf( const Ast::Node*, LlkState& ) const;
+    void llkAppend( LlkSet&, const Ast::Node*, LlkState& ) const;
+    static void llkConcat( LlkSet&, const LlkSet&, quint16 k );
 private:
     friend class EbnfAnalyzer;
-    Lookup d_first;
-    Lookup d_follow;
+    // The sets are bit sets over the elements, i.e. the terminal and pseudo terminal nodes in the order of
+    // the flat syntax; the NodeSet form is only generated on request.
+    const FlatSyntax* d_flat;
+    FlatSyntax d_ownFlat; // used if the syntax was not finished
+    QVector<quint32> d_elems; // element -> flat node index
+    QVector<quint32> d_elemOf; // flat node index -> element or Invalid
+    QVector<Ast::BitSet> d_first; // by flat node index
+    QBitArray d_firstKnown; // d_first is valid, even if empty
+    QVector<Ast::BitSet> d_follow; // by flat node index, the additional last entry belongs to key 0
+    // results in NodeSet and NodeRefSet form, including empty ones; Nonterminals are looked up by the
+    // root of their definition
+    QHash<const Ast::Node*,Ast::NodeSet> d_firstNodes;
+    QHash<const Ast::Node*,Ast::NodeRefSet> d_firstRefs;
+    QHash<const Ast::Node*,Ast::NodeSet> d_followNodes;
+    QHash<const Ast::Node*,Ast::NodeRefSet> d_followRefs;
+    CacheStats d_stats;
+    QVector<const Ast::Node*> d_symLeaf; // EbnfSyntax::getSymId -> first leaf with the symbol
+    QHash<quint16,LlkState> d_llk;
+    mutable QMutex d_lock; // the queries fill the caches and may come from several threads, unless d_frozen
     EbnfSyntaxRef d_syn;
     bool d_includeNts;
+    bool d_frozen;
 };
 
 #endif // _FirstFollowSet_H
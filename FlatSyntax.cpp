@@ -0,0 +1,412 @@
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "FlatSyntax.h"
+#include "EbnfSyntax.h"
+#include <QBitArray>
+#include <algorithm>
+
+void FlatSyntax::build(const EbnfSyntax* syn)
+{
+    clear();
+    const EbnfSyntax::OrderedDefs& order = syn->getOrderedDefs();
+    QHash<const Ast::Definition*,quint32> defIndex;
+    defIndex.reserve( order.size() );
+    d_defs.reserve( order.size() );
+    for( int i = 0; i < order.size(); i++ )
+    {
+        defIndex.insert( order[i], i );
+        d_defs.append( order[i] );
+    }
+    d_root.fill( Invalid, order.size() );
+    d_end.fill( Invalid, order.size() );
+    d_defFlags.fill( 0, order.size() );
+
+    for( int d = 0; d < order.size(); d++ )
+    {
+        Ast::Definition* def = order[d];
+        if( def->doIgnore() )
+            d_defFlags[d] |= Ignore;
+        if( def->d_nullable )
+            d_defFlags[d] |= Nullable;
+        if( def->d_repeatable )
+            d_defFlags[d] |= Repeatable;
+        if( def->d_node == 0 )
+            continue;
+        // breadth first; the children of the node at index i are appended when i is visited
+        const quint32 root = d_node.size();
+        d_root[d] = root;
+        d_node.append( def->d_node );
+        for( quint32 i = root; i < quint32(d_node.size()); i++ )
+        {
+            const Ast::Node* n = d_node[i];
+            d_firstChild.append( d_node.size() );
+            d_childCount.append( n->d_subs.size() );
+            foreach( Ast::Node* sub, n->d_subs )
+                d_node.append( sub );
+        }
+        d_end[d] = d_node.size();
+        for( quint32 i = root; i < quint32(d_node.size()); i++ )
+            d_owner.append( d );
+    }
+
+    const quint32 count = d_node.size();
+    d_type.resize( count );
+    d_quant.resize( count );
+    d_flags.resize( count );
+    d_symId.resize( count );
+    d_def.resize( count );
+    d_target.resize( count );
+    for( quint32 i = 0; i < count; i++ )
+    {
+        Ast::Node* n = d_node[i];
+        n->d_id = i;
+        d_type[i] = n->d_type;
+        d_quant[i] = n->d_quant;
+        d_flags[i] = ( n->doIgnore() ? Ignore : 0 ) | ( n->isLiteral() ? Literal : 0 );
+        d_symId[i] = syn->getSymId( n );
+        d_def[i] = n->d_def ? defIndex.value( n->d_def, Invalid ) : quint32(Invalid);
+        d_target[i] = d_def[i] != Invalid ? d_root[d_def[i]] : quint32(Invalid);
+    }
+    for( int d = 0; d < d_defs.size(); d++ )
+        updateNullable( d );
+    d_built = true;
+}
+
+void FlatSyntax::clear()
+{
+    d_type.clear();
+    d_quant.clear();
+    d_flags.clear();
+    d_symId.clear();
+    d_firstChild.clear();
+    d_childCount.clear();
+    d_def.clear();
+    d_target.clear();
+    d_owner.clear();
+    d_node.clear();
+    d_defs.clear();
+    d_root.clear();
+    d_end.clear();
+    d_defFlags.clear();
+    d_built = false;
+}
+
+quint32 FlatSyntax::indexOf(const Ast::Node* n) const
+{
+    if( n == 0 || n->d_id >= quint32(d_node.size()) || d_node[n->d_id] != n )
+        return Invalid;
+    return n->d_id;
+}
+
+void FlatSyntax::calculateNullable()
+{
+    QVector<quint32> defs( d_defs.size() );
+    for( int d = 0; d < defs.size(); d++ )
+        defs[d] = d;
+    calculateNullable( defs );
+}
+
+void FlatSyntax::calculateNullable(const QVector<quint32>& defs)
+{
+    // Worklist over the definitions in the list; same rules as Ast::Node::calcFlags. A definition is only
+    // evaluated again if the flags of a definition it references changed. The definitions not in the list
+    // keep their flags, so they must not depend on the ones in the list.
+
+    // the scratch arrays are indexed by the position in the sorted list, so a small list is cheap
+    QVector<quint32> sorted = defs;
+    std::sort( sorted.begin(), sorted.end() );
+    const quint32 count = sorted.size();
+    const bool all = count == quint32(d_defs.size()); // then the position is the definition
+    QVector< QPair<quint32,quint32> > refs; // positions of the referenced and the referencing definition
+    for( quint32 p = 0; p < count; p++ )
+    {
+        const quint32 d = sorted[p];
+        d_defFlags[d] &= ~( Nullable | Repeatable );
+        if( d_root[d] == Invalid )
+            continue;
+        for( quint32 i = d_root[d]; i < d_end[d]; i++ )
+        {
+            if( d_def[i] == Invalid )
+                continue;
+            if( all )
+            {
+                refs.append( qMakePair( d_def[i], p ) );
+                continue;
+            }
+            QVector<quint32>::const_iterator j = std::lower_bound( sorted.constBegin(), sorted.constEnd(), d_def[i] );
+            if( j != sorted.constEnd() && *j == d_def[i] )
+                refs.append( qMakePair( quint32( j - sorted.constBegin() ), p ) );
+        }
+    }
+    QVector<quint32> first( count + 1, 0 ); // users[first[p]..first[p+1]) reference sorted[p], possibly repeated
+    for( int k = 0; k < refs.size(); k++ )
+        first[refs[k].first + 1]++;
+    for( quint32 p = 0; p < count; p++ )
+        first[p + 1] += first[p];
+    QVector<quint32> users( refs.size() );
+    QVector<quint32> fill = first;
+    for( int k = 0; k < refs.size(); k++ )
+        users[fill[refs[k].first]++] = refs[k].second;
+
+    // the productions are usually written top down, so the last ones are evaluated first
+    QVector<quint32> todo( count );
+    for( quint32 p = 0; p < count; p++ )
+        todo[p] = p;
+    QBitArray queued( count, true );
+    quint32 visits = 0;
+    while( !todo.isEmpty() )
+    {
+        visits++;
+        const quint32 p = todo.back();
+        todo.pop_back();
+        queued.clearBit(p);
+        const quint32 d = sorted[p];
+        if( d_root[d] == Invalid )
+            continue;
+        updateNullable( d );
+        const quint8 flags = d_flags[d_root[d]] & ( Nullable | Repeatable );
+        if( flags != ( d_defFlags[d] & ( Nullable | Repeatable ) ) )
+        {
+            d_defFlags[d] = ( d_defFlags[d] & ~( Nullable | Repeatable ) ) | flags;
+            for( quint32 j = first[p]; j < first[p + 1]; j++ )
+            {
+                if( !queued.testBit( users[j] ) )
+                {
+                    queued.setBit( users[j] );
+                    todo.append( users[j] );
+                }
+            }
+        }
+    }
+
+    EbnfProfiler::addIterations( "calculateNullable", visits );
+
+    // The computation will terminate because
+    // - the variables are only changed monotonically (from false to true)
+    // - the number of possible changes is finite (from all false to all true)
+
+    foreach( quint32 d, defs )
+        storeFlags( d );
+}
+
+void FlatSyntax::storeFlags(quint32 d)
+{
+    d_defs[d]->d_nullable = hasDefFlag( d, Nullable );
+    d_defs[d]->d_repeatable = hasDefFlag( d, Repeatable );
+    if( d_root[d] == Invalid )
+        return;
+    for( quint32 i = d_root[d]; i < d_end[d]; i++ )
+    {
+        Ast::Node* n = d_node[i];
+        n->d_flags = ( n->d_flags & ~( Ast::Node::Nullable | Ast::Node::Repeatable ) ) |
+                ( d_flags[i] & Nullable ? Ast::Node::Nullable : 0 ) |
+                ( d_flags[i] & Repeatable ? Ast::Node::Repeatable : 0 );
+    }
+}
+
+FlatSyntax::Graph FlatSyntax::transpose(const Graph& g)
+{
+    Graph res( g.size() );
+    for( int v = 0; v < g.size(); v++ )
+    {
+        foreach( quint32 w, g[v] )
+            res[w].append( v );
+    }
+    return res;
+}
+
+QBitArray FlatSyntax::reachable(const Graph& g, const QBitArray& from)
+{
+    QBitArray res = from;
+    QVector<quint32> todo;
+    for( int v = 0; v < from.size(); v++ )
+    {
+        if( from.testBit(v) )
+            todo.append( v );
+    }
+    while( !todo.isEmpty() )
+    {
+        const quint32 v = todo.back();
+        todo.pop_back();
+        foreach( quint32 w, g[v] )
+        {
+            if( !res.testBit(w) )
+            {
+                res.setBit(w);
+                todo.append(w);
+            }
+        }
+    }
+    return res;
+}
+
+void FlatSyntax::updateNullable(quint32 d)
+{
+    if( d_root[d] == Invalid )
+        return;
+    // children have higher indices than their parent, so a reverse sweep sees them first
+    for( quint32 i = d_end[d]; i-- > d_root[d]; )
+    {
+        bool nullable = d_quant[i] != Ast::Node::One;
+        bool repeatable = d_quant[i] == Ast::Node::ZeroOrMore;
+        switch( d_type[i] )
+        {
+        case Ast::Node::Nonterminal:
+            if( d_def[i] != Invalid )
+            {
+                nullable |= hasDefFlag( d_def[i], Nullable );
+                repeatable |= hasDefFlag( d_def[i], Repeatable );
+            }
+            break;
+        case Ast::Node::Sequence:
+        case Ast::Node::Alternative:
+            {
+                const bool seq = d_type[i] == Ast::Node::Sequence;
+                bool all = true, any = false;
+                quint32 visible = 0, last = Invalid;
+                const quint32 end = d_firstChild[i] + d_childCount[i];
+                for( quint32 j = d_firstChild[i]; j < end; j++ )
+                {
+                    if( d_flags[j] & Ignore )
+                        continue;
+                    if( d_flags[j] & Nullable )
+                        any = true;
+                    else
+                        all = false;
+                    visible++;
+                    last = j;
+                }
+                nullable |= seq ? all : any;
+                if( visible == 1 )
+                    repeatable |= bool( d_flags[last] & Repeatable );
+            }
+            break;
+        default:
+            break;
+        }
+        d_flags[i] = ( d_flags[i] & ~( Nullable | Repeatable ) ) |
+                ( nullable ? Nullable : 0 ) | ( repeatable ? Repeatable : 0 );
+    }
+}
+
+FlatSyntax::Graph FlatSyntax::calcStartGraph() const
+{
+    // a definition can start with each non-ignored element of an alternative and with the elements of a
+    // sequence up to and including the first one which is not nullable
+    Graph res( d_defs.size() );
+    QVector<quint32> todo;
+    for( int d = 0; d < d_defs.size(); d++ )
+    {
+        if( d_root[d] == Invalid )
+            continue;
+        todo.append( d_root[d] );
+        while( !todo.isEmpty() )
+        {
+            const quint32 i = todo.back();
+            todo.pop_back();
+            if( d_flags[i] & Ignore )
+                continue;
+            const quint32 end = d_firstChild[i] + d_childCount[i];
+            switch( d_type[i] )
+            {
+            case Ast::Node::Nonterminal:
+                if( d_target[i] != Invalid && !res[d].contains( d_def[i] ) )
+                    res[d].append( d_def[i] );
+                break;
+            case Ast::Node::Alternative:
+                for( quint32 j = d_firstChild[i]; j < end; j++ )
+                    todo.append( j );
+                break;
+            case Ast::Node::Sequence:
+                for( quint32 j = d_firstChild[i]; j < end; j++ )
+                {
+                    if( d_flags[j] & Ignore )
+                        continue;
+                    todo.append( j );
+                    if( !( d_flags[j] & Nullable ) )
+                        break;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    return res;
+}
+
+FlatSyntax::Components FlatSyntax::findComponents(const Graph& g)
+{
+    // Tarjan's algorithm with an explicit call stack, since chains of definitions can be long;
+    // a component is complete only after all components reachable from it
+    const quint32 n = g.size();
+    QVector<quint32> index( n, Invalid );
+    QVector<quint32> low( n, 0 );
+    QBitArray onStack( n );
+    QVector<quint32> stack;
+    QVector< QPair<quint32,int> > calls; // node, next successor
+    quint32 counter = 0;
+    Components res;
+    for( quint32 v = 0; v < n; v++ )
+    {
+        if( index[v] != Invalid )
+            continue;
+        index[v] = low[v] = counter++;
+        stack.append( v );
+        onStack.setBit( v );
+        calls.append( qMakePair( v, 0 ) );
+        while( !calls.isEmpty() )
+        {
+            const quint32 u = calls.back().first;
+            if( calls.back().second < g[u].size() )
+            {
+                const quint32 w = g[u][calls.back().second++];
+                if( index[w] == Invalid )
+                {
+                    index[w] = low[w] = counter++;
+                    stack.append( w );
+                    onStack.setBit( w );
+                    calls.append( qMakePair( w, 0 ) );
+                }else if( onStack.testBit( w ) )
+                    low[u] = qMin( low[u], index[w] );
+            }else
+            {
+                calls.pop_back();
+                if( !calls.isEmpty() )
+                    low[calls.back().first] = qMin( low[calls.back().first], low[u] );
+                if( low[u] == index[u] )
+                {
+                    QVector<quint32> comp;
+                    quint32 w;
+                    do
+                    {
+                        w = stack.back();
+                        stack.pop_back();
+                        onStack.clearBit( w );
+                        comp.append( w );
+                    }while( w != u );
+                    std::sort( comp.begin(), comp.end() );
+                    res.append( comp );
+                }
+            }
+        }
+    }
+    return res;
+}
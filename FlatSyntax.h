@@ -0,0 +1,99 @@
+#ifndef FLATSYNTAX_H
+#define FLATSYNTAX_H
+
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QVector>
+#include <QList>
+#include <QBitArray>
+
+class EbnfSyntax;
+
+namespace Ast
+{
+    struct Node;
+    struct Definition;
+}
+
+// Compiled structure-of-arrays form of the productions for the analysis passes, built by
+// EbnfSyntax::finishSyntax once the ignore flags are known. The nodes of each definition are numbered
+// breadth first, so the nodes of a definition and the children of a node occupy contiguous index ranges.
+class FlatSyntax
+{
+public:
+    enum { Invalid = 0xffffffff };
+    enum Flag { Ignore = 1, Nullable = 2, Repeatable = 4, Literal = 8 };
+    typedef QVector< QVector<quint32> > Graph; // successor lists by definition index
+    typedef QList< QVector<quint32> > Components;
+
+    FlatSyntax():d_built(false){}
+    void build( const EbnfSyntax* ); // node flags reflect the current Definition::d_nullable/d_repeatable
+    void clear();
+    bool isBuilt() const { return d_built; }
+    void calculateNullable(); // over all definitions; results are written back to the Definitions and Nodes
+    void calculateNullable( const QVector<quint32>& defs ); // the others keep their current flags
+    void storeFlags( quint32 d ); // writes the flags of the definition and its nodes back to the Ast
+    Graph calcStartGraph() const; // edges to the definitions referenced where a definition can start
+    static Components findComponents( const Graph& ); // strongly connected, successors first
+    static Graph transpose( const Graph& );
+    static QBitArray reachable( const Graph&, const QBitArray& from ); // including from
+
+    // nodes
+    quint32 getNodeCount() const { return d_node.size(); }
+    const Ast::Node* getNode( quint32 i ) const { return d_node[i]; }
+    quint32 indexOf( const Ast::Node* n ) const; // Ast::Node::d_id if n belongs to this flat syntax
+    quint8 getType( quint32 i ) const { return d_type[i]; } // Ast::Node::Type
+    quint8 getQuant( quint32 i ) const { return d_quant[i]; } // Ast::Node::Quantity
+    bool hasFlag( quint32 i, Flag f ) const { return d_flags[i] & f; }
+    quint32 getSymId( quint32 i ) const { return d_symId[i]; } // EbnfSyntax::getSymId
+    quint32 getFirstChild( quint32 i ) const { return d_firstChild[i]; }
+    quint32 getChildCount( quint32 i ) const { return d_childCount[i]; }
+    quint32 getDef( quint32 i ) const { return d_def[i]; } // referenced definition or Invalid
+    quint32 getTarget( quint32 i ) const { return d_target[i]; } // root of the referenced definition or Invalid
+    quint32 getOwner( quint32 i ) const { return d_owner[i]; }
+
+    // definitions in the order of EbnfSyntax::getOrderedDefs
+    quint32 getDefCount() const { return d_defs.size(); }
+    Ast::Definition* getDefinition( quint32 d ) const { return d_defs[d]; }
+    quint32 getRoot( quint32 d ) const { return d_root[d]; } // Invalid if the definition has no node
+    quint32 getEnd( quint32 d ) const { return d_end[d]; }
+    bool hasDefFlag( quint32 d, Flag f ) const { return d_defFlags[d] & f; }
+protected:
+    void updateNullable( quint32 d );
+private:
+    QVector<quint8> d_type;
+    QVector<quint8> d_quant;
+    QVector<quint8> d_flags;
+    QVector<quint32> d_symId;
+    QVector<quint32> d_firstChild;
+    QVector<quint32> d_childCount;
+    QVector<quint32> d_def;
+    QVector<quint32> d_target;
+    QVector<quint32> d_owner;
+    QVector<Ast::Node*> d_node;
+
+    QVector<Ast::Definition*> d_defs;
+    QVector<quint32> d_root;
+    QVector<quint32> d_end;
+    QVector<quint8> d_defFlags;
+    bool d_built;
+};
+
+#endif // FLATSYNTAX_H
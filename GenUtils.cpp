@@ -20,6 +20,10 @@
 #include "GenUtils.h"
 #include <QtDebug>
 #include <QHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QStringList>
 
 GenUtils::TokMap GenUtils::s_tokMap;
 
@@ -197,3 +201,22 @@ QStringList GenUtils::orderedTokenList(const QSet<QString>& tokens, bool applySy
     }
     return res;
 }
+
+bool GenUtils::loadTokMap(const QString& ebnfPath)
+{
+    s_tokMap.clear(); // a grammar without .tokmap gets the default names, not the ones of the previous grammar
+    QFileInfo info(ebnfPath);
+    QFile in( info.absoluteDir().absoluteFilePath( info.completeBaseName() + ".tokmap") );
+    if( !in.open(QIODevice::ReadOnly) )
+        return false;
+
+    TokMap m;
+    while( !in.atEnd() )
+    {
+        const QStringList pair = QString::fromUtf8( in.readLine().simplified() ).split(' ');
+        if( pair.size() == 2 )
+            m.insert(pair.first(),pair.last());
+    }
+    s_tokMap = m;
+    return true;
+}
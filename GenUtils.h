@@ -28,6 +28,7 @@ class GenUtils
 public:
     typedef QHash<QString,QString> TokMap;
     static TokMap s_tokMap;
+    static bool loadTokMap( const QString& ebnfPath ); // reads <base>.tokmap into s_tokMap
     static QString escapeDollars(QString name );
     static bool containsAlnum( const QString& str );
     static bool looksLikeKeyword( const QString& str );
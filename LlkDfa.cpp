@@ -0,0 +1,520 @@
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LlkDfa.h"
+#include "FirstFollowSet.h"
+#include <algorithm>
+
+LlkDfa::LlkDfa(FirstFollowSet* set, quint16 k):d_set(set),d_syn(set->getSyntax()),d_unpruned(0),d_edgeCount(0),
+    d_k(qBound(quint16(1),k,quint16(32))),d_complete(true),d_ambiguous(false)
+{
+    // stack 0 is the empty stack
+    Frame empty;
+    empty.d_what = 0;
+    empty.d_below = Empty;
+    empty.d_height = 0;
+    empty.d_kind = Cut;
+    empty.d_need = 0;
+    empty.d_pos = 0;
+    d_frames.append( empty );
+}
+
+void LlkDfa::build(const Ast::Node* alt, int a, int b)
+{
+    setShared( d_set->getLlkEntrySet( alt->d_subs[a], d_k ).d_pos, d_set->getLlkEntrySet( alt->d_subs[b], d_k ).d_pos );
+    const quint32 after = stackAfter( alt, true );
+    run( push( Match, alt->d_subs[a], after ), push( Match, alt->d_subs[b], after ) );
+}
+
+void LlkDfa::build(const Ast::Node* opt)
+{
+    setShared( d_set->getLlkEntrySet( opt, d_k ).d_pos, d_set->getLlkFollowSet( opt, d_k ).d_pos );
+    run( push( Body, opt, stackAfter( opt, true ) ), stackAfter( opt, false ) );
+}
+
+quint32 LlkDfa::push(Kind kind, const void* what, quint32 below, quint8 pos)
+{
+    const QPair<const void*,quint64> key( what, quint64(kind) << 40 | quint64(pos) << 32 | below );
+    QHash<QPair<const void*,quint64>,quint32>::const_iterator i = d_frameIndex.find( key );
+    if( i != d_frameIndex.end() )
+        return i.value();
+    Frame f;
+    f.d_what = what;
+    f.d_below = below;
+    f.d_height = qMin( d_frames[below].d_height + 1, 0xffff );
+    f.d_kind = kind;
+    f.d_need = qMin( d_frames[below].d_need + ( consumes( kind, what ) ? 1 : 0 ), 0xff );
+    f.d_pos = pos;
+    const quint32 id = d_frames.size();
+    d_frames.append( f );
+    d_frameIndex.insert( key, id );
+    return id;
+}
+
+void LlkDfa::setShared(const QVector<Ast::BitSet>& lhs, const QVector<Ast::BitSet>& rhs)
+{
+    // A configuration whose next symbol is not shared at its depth can only lead to a state predicting one
+    // alternative, so the closure skips the elements which cannot start with a shared symbol.
+    d_shared.resize( d_k );
+    for( int d = 0; d < d_k; d++ )
+    {
+        if( d < lhs.size() && d < rhs.size() )
+            d_shared[d] = lhs[d] & rhs[d];
+        if( d_shared[d].nextBit( d_syn->getTermCount() ) != Ast::BitSet::Invalid )
+            d_unpruned |= 1 << d;
+    }
+}
+
+bool LlkDfa::isRelevant(const Ast::Node* n, quint16 remaining)
+{
+    const quint32 d = d_k - remaining;
+    if( d_unpruned & ( 1 << d ) )
+        return true;
+    QHash<const Ast::Node*,quint32>::const_iterator i = d_relevant.find( n );
+    if( i == d_relevant.end() )
+    {
+        const Ast::BitSet first = d_set->getFirstTerms( n );
+        quint32 mask = 0;
+        for( int x = 0; x < d_shared.size(); x++ )
+        {
+            if( first.intersects( d_shared[x] ) )
+                mask |= 1 << x;
+        }
+        i = d_relevant.insert( n, mask );
+    }
+    return i.value() & ( 1 << d );
+}
+
+bool LlkDfa::isBodyNullable(const Ast::Node* n)
+{
+    if( n->d_quant == Ast::Node::One )
+        return n->isNullable();
+    switch( n->d_type )
+    {
+    case Ast::Node::Terminal:
+        return false;
+    case Ast::Node::Nonterminal:
+        return n->d_def != 0 && n->d_def->isNullable();
+    case Ast::Node::Sequence:
+        foreach( Ast::Node* sub, n->d_subs )
+        {
+            if( !sub->doIgnore() && !sub->isNullable() )
+                return false;
+        }
+        return true;
+    case Ast::Node::Alternative:
+        foreach( Ast::Node* sub, n->d_subs )
+        {
+            if( !sub->doIgnore() && sub->isNullable() )
+                return true;
+        }
+        return false;
+    default:
+        return true;
+    }
+}
+
+bool LlkDfa::consumes(Kind kind, const void* what)
+{
+    if( kind != Match && kind != Body )
+        return false;
+    const Ast::Node* n = static_cast<const Ast::Node*>( what );
+    if( n->doIgnore() )
+        return false;
+    if( kind == Match )
+        return !n->isNullable();
+    switch( n->d_type )
+    {
+    case Ast::Node::Terminal:
+        return true;
+    case Ast::Node::Nonterminal:
+        return n->d_def == 0 || n->d_def->d_node == 0 || !n->d_def->isNullable();
+    default:
+        return false; // conservative, only used to drop frames
+    }
+}
+
+quint32 LlkDfa::truncate(quint32 stack, quint16 remaining)
+{
+    // The frames below the first remaining ones which consume a symbol cannot be reached within the remaining
+    // symbols, so all stacks only differing there are equivalent; this bounds the number of stacks by the
+    // positions up to k symbols deep instead of all chains of calls. Truncation only lowers the heights, so
+    // the left recursion check in closure can miss a recursion, which then ends by truncation, but never
+    // reports a wrong one.
+    if( d_frames[stack].d_need <= remaining )
+        return stack;
+    QVector<quint32> keep;
+    quint16 count = 0;
+    while( count < remaining )
+    {
+        keep.append( stack );
+        if( consumes( Kind(d_frames[stack].d_kind), d_frames[stack].d_what ) )
+            count++;
+        stack = d_frames[stack].d_below;
+    }
+    quint32 res = push( Cut, 0, Empty );
+    for( int i = keep.size() - 1; i >= 0; i-- )
+        res = push( Kind(d_frames[keep[i]].d_kind), d_frames[keep[i]].d_what, res );
+    return res;
+}
+
+quint32 LlkDfa::stackAfter(const Ast::Node* node, bool repeat)
+{
+    if( repeat )
+    {
+        QHash<const Ast::Node*,quint32>::const_iterator i = d_after.find( node );
+        if( i != d_after.end() )
+            return i.value();
+    }
+    // the rest of the enclosing sequences and the pending repetitions up to the definition, nearest first;
+    // same walk as FirstFollowSet::llkFollowOf
+    QVector<const Ast::Node*> todo;
+    if( repeat && node->d_quant == Ast::Node::ZeroOrMore )
+        todo.append( node );
+    Ast::FollowCursor next( node );
+    for( ; !next.atEnd(); ++next )
+    {
+        if( next.isRepeat() || !(*next)->doIgnore() )
+            todo.append( *next );
+    }
+    quint32 res = push( Follow, next.getTop()->d_owner, Empty );
+    for( int i = todo.size() - 1; i >= 0; i-- )
+        res = push( Match, todo[i], res );
+    if( repeat )
+        d_after.insert( node, res );
+    return res;
+}
+
+const FirstFollowSet::LlkSet& LlkDfa::followOf(const Ast::Definition* d)
+{
+    QHash<const Ast::Definition*,FirstFollowSet::LlkSet>::const_iterator i = d_follow.find( d );
+    if( i == d_follow.end() )
+        i = d_follow.insert( d, d->d_node ? d_set->getLlkFollowSet( d->d_node, d_k ) : FirstFollowSet::LlkSet( d_k ) );
+    return i.value();
+}
+
+const QVector<quint32>& LlkDfa::closure(quint32 start, quint16 remaining)
+{
+    // expands the stack until a terminal (or an unresolved nonterminal) or the follow of the definition is on top;
+    // the result does not depend on the alternative, so it is shared by all configurations with this stack
+    const quint64 key = quint64(remaining) << 32 | start;
+    QHash<quint64,QVector<quint32> >::const_iterator i = d_closure.find( key );
+    if( i != d_closure.end() )
+        return i.value();
+    QVector<quint32> out;
+    QSet<quint32> visited;
+    // the definitions being expanded, each with the stack height of its body; reaching one again before its
+    // body is popped is left recursion, which would grow the stack without consuming symbols
+    struct Expansion
+    {
+        const Ast::Definition* d_def;
+        quint32 d_up;
+        quint16 d_height;
+    };
+    QVector<Expansion> path;
+    const Expansion none = { 0, 0, 0 };
+    path.append( none );
+    QVector< QPair<quint32,quint32> > todo; // stack, path
+    todo.append( qMakePair( start, quint32(0) ) );
+    while( !todo.isEmpty() && d_complete )
+    {
+        const quint32 stack = truncate( todo.back().first, remaining );
+        quint32 up = todo.back().second;
+        todo.pop_back();
+        if( visited.contains( stack ) )
+            continue;
+        visited.insert( stack );
+        const Frame f = d_frames[stack];
+        if( f.d_kind == Follow )
+        {
+            out.append( stack );
+            continue;
+        }
+        if( stack == Empty || f.d_height > MaxStack || f.d_kind == Cut )
+        {
+            d_complete = false;
+            continue;
+        }
+        while( up != 0 && path[up].d_height > f.d_height )
+            up = path[up].d_up;
+        const Ast::Node* n = static_cast<const Ast::Node*>( f.d_what );
+        if( !n->doIgnore() && !isRelevant( n, remaining ) )
+        {
+            if( f.d_kind == Match ? n->isNullable() : isBodyNullable( n ) )
+                todo.append( qMakePair( f.d_below, up ) );
+            continue;
+        }
+        if( f.d_kind == Match )
+        {
+            if( n->doIgnore() )
+                todo.append( qMakePair( f.d_below, up ) );
+            else if( n->d_quant == Ast::Node::One )
+                todo.append( qMakePair( push( Body, n, f.d_below ), up ) );
+            else
+            {
+                todo.append( qMakePair( f.d_below, up ) );
+                if( n->d_quant == Ast::Node::ZeroOrMore )
+                    todo.append( qMakePair( push( Body, n, stack ), up ) );
+                else
+                    todo.append( qMakePair( push( Body, n, f.d_below ), up ) );
+            }
+            continue;
+        }
+        switch( n->d_type )
+        {
+        case Ast::Node::Terminal:
+        case Ast::Node::Nonterminal:
+            if( n->d_type == Ast::Node::Nonterminal && n->d_def && n->d_def->d_node )
+            {
+                quint32 e = up;
+                while( e != 0 && path[e].d_def != n->d_def )
+                    e = path[e].d_up;
+                if( e != 0 )
+                {
+                    d_complete = false;
+                    break;
+                }
+                const Expansion x = { n->d_def, up, f.d_height };
+                path.append( x );
+                todo.append( qMakePair( push( Match, n->d_def->d_node, f.d_below ), quint32(path.size() - 1) ) );
+            }else
+                out.append( stack );
+            break;
+        case Ast::Node::Sequence:
+            {
+                quint32 res = f.d_below;
+                for( int i = n->d_subs.size() - 1; i >= 0; i-- )
+                {
+                    if( !n->d_subs[i]->doIgnore() )
+                        res = push( Match, n->d_subs[i], res );
+                }
+                todo.append( qMakePair( res, up ) );
+            }
+            break;
+        case Ast::Node::Alternative:
+            {
+                bool any = false;
+                foreach( Ast::Node* sub, n->d_subs )
+                {
+                    if( sub->doIgnore() )
+                        continue;
+                    todo.append( qMakePair( push( Match, sub, f.d_below ), up ) );
+                    any = true;
+                }
+                if( !any )
+                    todo.append( qMakePair( f.d_below, up ) );
+            }
+            break;
+        default:
+            todo.append( qMakePair( f.d_below, up ) );
+            break;
+        }
+    }
+    std::sort( out.begin(), out.end() );
+    out.erase( std::unique( out.begin(), out.end() ), out.end() );
+    return d_closure.insert( key, out ).value();
+}
+
+void LlkDfa::addClosure(Configs& out, quint32 alt, quint32 stack, quint16 remaining)
+{
+    foreach( quint32 s, closure( stack, remaining ) )
+        out.append( config( alt, s ) );
+}
+
+void LlkDfa::addSymbols(QVector<QPair<quint32,Config> >& out, Config c)
+{
+    const Frame& f = d_frames[c & 0xffffffff];
+    if( f.d_kind != Follow )
+    {
+        out.append( qMakePair( d_syn->getSymId( static_cast<const Ast::Node*>( f.d_what ) ), c ) );
+        return;
+    }
+    const FirstFollowSet::LlkSet& follow = followOf( static_cast<const Ast::Definition*>( f.d_what ) );
+    if( f.d_pos >= follow.d_pos.size() )
+        return;
+    const Ast::BitSet& syms = follow.d_pos[f.d_pos];
+    for( quint32 s = syms.nextBit( 0 ); s != Ast::BitSet::Invalid; s = syms.nextBit( s + 1 ) )
+        out.append( qMakePair( s, c ) );
+    if( follow.d_ends & ( 1 << f.d_pos ) )
+        out.append( qMakePair( quint32(Eof), c ) );
+}
+
+quint32 LlkDfa::advance(quint32 stack)
+{
+    // the stack after the symbol on top; the follow only remembers the position, not which symbols were seen
+    const Frame& f = d_frames[stack];
+    if( f.d_kind == Follow )
+        return push( Follow, f.d_what, Empty, f.d_pos + 1 );
+    return f.d_below;
+}
+
+const LlkDfa::Next& LlkDfa::nextOf(quint32 stack)
+{
+    // the symbols which can come next, i.e. the closure for the last symbol in the form of the sets
+    QHash<quint32,Next>::const_iterator i = d_next.find( stack );
+    if( i != d_next.end() )
+        return i.value();
+    Next res;
+    quint32 s = stack;
+    while( true )
+    {
+        const Frame& f = d_frames[s];
+        if( s == Empty || f.d_kind == Cut )
+            break;
+        if( f.d_kind == Follow )
+        {
+            const FirstFollowSet::LlkSet& follow = followOf( static_cast<const Ast::Definition*>( f.d_what ) );
+            if( f.d_pos < follow.d_pos.size() )
+            {
+                res.d_syms.unite( follow.d_pos[f.d_pos] );
+                res.d_eof = follow.d_ends & ( 1 << f.d_pos );
+            }
+            break;
+        }
+        const Ast::Node* n = static_cast<const Ast::Node*>( f.d_what );
+        if( !n->doIgnore() )
+        {
+            QHash<const Ast::Node*,Ast::BitSet>::const_iterator j = d_first.find( n );
+            if( j == d_first.end() )
+                j = d_first.insert( n, d_set->getLlkFirstSet( n, 1 ).d_pos[0] );
+            res.d_syms.unite( j.value() );
+            if( !( f.d_kind == Match ? n->isNullable() : isBodyNullable( n ) ) )
+                break;
+        }
+        s = f.d_below;
+    }
+    return d_next.insert( stack, res ).value();
+}
+
+bool LlkDfa::sharesNext(const Next& lhs, const Next& rhs)
+{
+    return ( lhs.d_eof && rhs.d_eof ) || lhs.d_syms.intersects( rhs.d_syms );
+}
+
+void LlkDfa::run(quint32 a, quint32 b)
+{
+    if( d_k == 1 )
+    {
+        d_ambiguous = sharesNext( nextOf( a ), nextOf( b ) );
+        return;
+    }
+    Configs start;
+    addClosure( start, 0, a, d_k );
+    addClosure( start, 1, b, d_k );
+    // Only the states still predicting both alternatives are built; an input symbol seen by one alternative
+    // only leads to a state predicting it, which needs no closure. Neither is a state built for the last
+    // symbol, for which the sets of symbols coming next suffice.
+    if( !isMixed( start ) )
+        return;
+    // depth first, so an ambiguity is found without building all states of a lower depth before
+    QVector<quint32> todo;
+    todo.append( addState( start, 0 ) );
+    while( !todo.isEmpty() && d_complete )
+    {
+        const State st = d_states[todo.back()];
+        todo.pop_back();
+        QVector< QPair<quint32,Config> > bySym;
+        bySym.reserve( st.d_configs.size() );
+        foreach( Config c, st.d_configs )
+            addSymbols( bySym, c );
+        std::sort( bySym.begin(), bySym.end() );
+        for( int i = 0; i < bySym.size(); )
+        {
+            const quint32 sym = bySym[i].first;
+            int j = i;
+            while( j < bySym.size() && bySym[j].first == sym )
+                j++;
+            const bool both = ( bySym[i].second >> 32 ) != ( bySym[j-1].second >> 32 );
+            d_edgeCount++;
+            if( both && ( sym == Eof || st.d_depth + 1 >= d_k ) )
+            {
+                d_ambiguous = true;
+                return;
+            }
+            if( both && st.d_depth + 2 == d_k )
+            {
+                Next next[2];
+                for( int x = i; x < j; x++ )
+                {
+                    const Config c = bySym[x].second;
+                    const Next& n = nextOf( advance( c & 0xffffffff ) );
+                    next[c >> 32].d_syms.unite( n.d_syms );
+                    next[c >> 32].d_eof |= n.d_eof;
+                }
+                if( sharesNext( next[0], next[1] ) )
+                {
+                    d_ambiguous = true;
+                    return;
+                }
+            }else if( both )
+            {
+                Configs next;
+                for( int x = i; x < j; x++ )
+                {
+                    const Config c = bySym[x].second;
+                    addClosure( next, c >> 32, advance( c & 0xffffffff ), d_k - st.d_depth - 1 );
+                }
+                if( isMixed( next ) )
+                {
+                    const int count = d_states.size();
+                    const quint32 id = addState( next, st.d_depth + 1 );
+                    if( d_states.size() > count )
+                        todo.append( id );
+                }
+            }
+            i = j;
+        }
+        if( d_states.size() > MaxStates || d_frames.size() > MaxFrames )
+        {
+            d_complete = false;
+            return;
+        }
+    }
+}
+
+bool LlkDfa::isMixed(const Configs& configs)
+{
+    if( configs.isEmpty() )
+        return false;
+    const quint32 alt = configs.first() >> 32;
+    foreach( Config c, configs )
+    {
+        if( ( c >> 32 ) != alt )
+            return true;
+    }
+    return false;
+}
+
+quint32 LlkDfa::addState(Configs& configs, quint16 depth)
+{
+    std::sort( configs.begin(), configs.end() );
+    configs.erase( std::unique( configs.begin(), configs.end() ), configs.end() );
+    Configs key = configs;
+    key.append( depth );
+    QHash<Configs,quint32>::const_iterator i = d_stateIndex.find( key );
+    if( i != d_stateIndex.end() )
+        return i.value();
+    State s;
+    s.d_configs = configs;
+    s.d_depth = depth;
+    const quint32 id = d_states.size();
+    d_states.append( s );
+    d_stateIndex.insert( key, id );
+    return id;
+}
@@ -0,0 +1,113 @@
+#ifndef LLKDFA_H
+#define LLKDFA_H
+
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "FirstFollowSet.h"
+#include <QPair>
+
+// Lookahead DFA of a single decision between two alternatives up to k symbols, in the style of the ANTLR LL(*)
+// analysis. A configuration is the predicted alternative together with the stack of what remains to be parsed:
+// the elements still to match in the definition of the decision and in the definitions called from there, and
+// at the bottom the follow of the definition, which is approximated by position like FirstFollowSet::LlkSet.
+// A state is the set of configurations alive after an input prefix; alternatives still sharing a state after
+// k symbols or at the end of the input cannot be told apart. Within the definition and its callees the
+// positions stay correlated, so e.g. ( a b | c d ) and ( a d | c b ) are distinguished.
+class LlkDfa
+{
+public:
+    enum { MaxStates = 10000, MaxFrames = 1000000, MaxStack = 256 };
+
+    LlkDfa( FirstFollowSet*, quint16 k );
+    void build( const Ast::Node* alt, int a, int b ); // the subs a and b of an Alternative
+    void build( const Ast::Node* opt ); // entering or skipping an optional or repeated element
+    bool isAmbiguous() const { return d_ambiguous || !d_complete; }
+    bool isComplete() const { return d_complete; } // false if a limit was hit; the result is then conservative
+    quint32 getStateCount() const { return d_states.size(); } // the states still predicting both alternatives
+    quint32 getEdgeCount() const { return d_edgeCount; } // including those into the predicting states
+    quint32 getFrameCount() const { return d_frames.size(); } // interned stack frames
+protected:
+    // Match includes the quantifier, Body is one pass through the node, Follow is the follow of a definition
+    // from a position on, Cut replaces the frames out of reach of the remaining symbols
+    enum Kind { Match, Body, Follow, Cut };
+    enum { Empty = 0, Eof = 0xfffffffe }; // Eof differs from EbnfSyntax::InvalidId
+    struct Frame
+    {
+        const void* d_what; // Ast::Node or Ast::Definition for Follow
+        quint32 d_below;
+        quint16 d_height;
+        quint8 d_kind;
+        quint8 d_need; // frames in the stack which cannot be popped without consuming a symbol, up to 255
+        quint8 d_pos; // of Follow
+    };
+    typedef quint64 Config; // alternative << 32 | stack
+    typedef QVector<Config> Configs; // sorted
+    struct State
+    {
+        Configs d_configs;
+        quint16 d_depth;
+    };
+    struct Next
+    {
+        Ast::BitSet d_syms;
+        bool d_eof;
+        Next():d_eof(false){}
+    };
+
+    quint32 push( Kind, const void*, quint32 below, quint8 pos = 0 );
+    quint32 truncate( quint32 stack, quint16 remaining );
+    static bool consumes( Kind, const void* );
+    quint32 stackAfter( const Ast::Node*, bool repeat );
+    const FirstFollowSet::LlkSet& followOf( const Ast::Definition* );
+    void setShared( const QVector<Ast::BitSet>& lhs, const QVector<Ast::BitSet>& rhs );
+    bool isRelevant( const Ast::Node*, quint16 remaining );
+    static bool isBodyNullable( const Ast::Node* );
+    const QVector<quint32>& closure( quint32 stack, quint16 remaining );
+    void addClosure( Configs&, quint32 alt, quint32 stack, quint16 remaining );
+    void addSymbols( QVector< QPair<quint32,Config> >&, Config );
+    quint32 advance( quint32 stack );
+    const Next& nextOf( quint32 stack );
+    static bool sharesNext( const Next&, const Next& );
+    void run( quint32 a, quint32 b ); // the stacks of the two alternatives
+    quint32 addState( Configs&, quint16 depth );
+    static bool isMixed( const Configs& );
+    static Config config( quint32 alt, quint32 stack ) { return quint64(alt) << 32 | stack; }
+private:
+    FirstFollowSet* d_set;
+    const EbnfSyntax* d_syn;
+    QVector<Frame> d_frames;
+    QHash<QPair<const void*,quint64>,quint32> d_frameIndex;
+    QHash<const Ast::Node*,quint32> d_after; // stackAfter with repeat
+    QHash<const Ast::Definition*,FirstFollowSet::LlkSet> d_follow;
+    QVector<Ast::BitSet> d_shared; // by depth, the symbols both alternatives can see there
+    quint32 d_unpruned; // bit per depth, the shared symbols include ones not in the terminal FIRST sets
+    QHash<const Ast::Node*,quint32> d_relevant; // bit per depth, the FIRST set meets the shared symbols
+    QHash<const Ast::Node*,Ast::BitSet> d_first; // LL(1) FIRST including the symbols of unresolved nonterminals
+    QHash<quint64,QVector<quint32> > d_closure; // remaining << 32 | stack
+    QHash<quint32,Next> d_next;
+    QVector<State> d_states;
+    QHash<Configs,quint32> d_stateIndex; // the configurations followed by the depth
+    quint32 d_edgeCount;
+    quint16 d_k;
+    bool d_complete;
+    bool d_ambiguous;
+};
+
+#endif // LLKDFA_H
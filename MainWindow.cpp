@@ -32,6 +32,7 @@
 #include "FirstFollowSet.h"
 #include "AntlrGen.h"
 #include "CppGen.h"
+#include "EbnfProfiler.h"
 #include <QFile>
 #include <QFileInfo>
 #include <QtDebug>
@@ -401,7 +402,7 @@ void MainWindow::onExpandSelected()
 
 void MainWindow::onGenSynTree()
 {
-    ENABLED_IF( !d_edit->getPath().isEmpty() );
+    ENABLED_IF( !d_edit->getPath().isEmpty() && d_edit->isSyntaxFinished() );
 
     loadTokMap();
     SynTreeGen::generateTree( d_edit->getPath(), d_edit->getSyntax() );
@@ -412,7 +413,7 @@ void MainWindow::onGenSynTree()
 
 void MainWindow::onGenTt()
 {
-    ENABLED_IF( !d_edit->getPath().isEmpty() );
+    ENABLED_IF( !d_edit->getPath().isEmpty() && d_edit->isSyntaxFinished() );
 
     loadTokMap();
     SynTreeGen::generateTt( d_edit->getPath(), d_edit->getSyntax(), true, true );
@@ -420,7 +421,7 @@ void MainWindow::onGenTt()
 
 void MainWindow::onGenHtml()
 {
-    ENABLED_IF( !d_edit->getPath().isEmpty() );
+    ENABLED_IF( !d_edit->getPath().isEmpty() && d_edit->isSyntaxFinished() );
 
     HtmlSyntax gen;
     gen.generateHtml( d_edit->getPath(), d_edit->getSyntax() );
@@ -428,7 +429,7 @@ void MainWindow::onGenHtml()
 
 void MainWindow::onGenCoco()
 {
-    ENABLED_IF( !d_edit->getPath().isEmpty() );
+    ENABLED_IF( !d_edit->getPath().isEmpty() && d_edit->isSyntaxFinished() );
 
     loadTokMap();
     CocoGen gen;
@@ -441,7 +442,7 @@ void MainWindow::onGenCoco()
 
 void MainWindow::onGenCpp()
 {
-    ENABLED_IF( !d_edit->getPath().isEmpty() );
+    ENABLED_IF( !d_edit->getPath().isEmpty() && d_edit->isSyntaxFinished() );
     loadTokMap();
     CppGen gen;
     QFileInfo info(d_edit->getPath());
@@ -453,7 +454,7 @@ void MainWindow::onGenCpp()
 
 void MainWindow::onGenVisitor()
 {
-    ENABLED_IF( !d_edit->getPath().isEmpty() );
+    ENABLED_IF( !d_edit->getPath().isEmpty() && d_edit->isSyntaxFinished() );
     loadTokMap();
     CppGen gen;
     QFileInfo info(d_edit->getPath());
@@ -462,21 +463,21 @@ void MainWindow::onGenVisitor()
 
 void MainWindow::onGenAntlr()
 {
-    ENABLED_IF( !d_edit->getPath().isEmpty() );
+    ENABLED_IF( !d_edit->getPath().isEmpty() && d_edit->isSyntaxFinished() );
     QFileInfo info(d_edit->getPath());
     AntlrGen::generate( info.absoluteDir().absoluteFilePath( info.completeBaseName() + ".g"), d_edit->getSyntax() );
 }
 
 void MainWindow::onGenLlgen()
 {
-    ENABLED_IF( !d_edit->getPath().isEmpty() );
+    ENABLED_IF( !d_edit->getPath().isEmpty() && d_edit->isSyntaxFinished() );
     QFileInfo info(d_edit->getPath());
     LlgenGen::generate( info.absoluteDir().absoluteFilePath( info.completeBaseName() + ".g"), d_edit->getSyntax(), d_tbl );
 }
 
 void MainWindow::onOutputFirstSet()
 {
-    ENABLED_IF( !d_edit->getPath().isEmpty() );
+    ENABLED_IF( !d_edit->getPath().isEmpty() && d_edit->isSyntaxFinished() );
 
     QFileInfo info(d_edit->getPath());
     QFile f( info.absoluteDir().absoluteFilePath( info.completeBaseName() + ".first") );
@@ -526,7 +527,7 @@ void MainWindow::onUsedByDblClicked()
 
 void MainWindow::onFindAmbig()
 {
-    ENABLED_IF(true);
+    ENABLED_IF( d_edit->isSyntaxFinished() );
 
     EbnfAnalyzer a;
     d_tbl->setSyntax(d_edit->getSyntax());
@@ -534,6 +535,37 @@ void MainWindow::onFindAmbig()
     d_edit->updateExtraSelections();
 }
 
+void MainWindow::onProfile()
+{
+    ENABLED_IF( !d_edit->getPath().isEmpty() );
+
+    EbnfProfiler::reset();
+    EbnfProfiler::setEnabled(true);
+    d_edit->reparse();
+    d_tbl->clear();
+    if( d_edit->isSyntaxFinished() )
+    {
+        d_tbl->setSyntax(d_edit->getSyntax());
+        EbnfAnalyzer::checkForAmbiguity( d_tbl, d_edit->getErrs() );
+    }
+    EbnfProfiler::setEnabled(false);
+    d_edit->updateExtraSelections();
+
+    const EbnfProfiler::Entries l = EbnfProfiler::getEntries();
+    QFileInfo info(d_edit->getPath());
+    const QString path = info.absoluteDir().absoluteFilePath( info.completeBaseName() + ".profile" );
+    QFile txt( path );
+    QFile json( path + ".json" );
+    if( !txt.open(QIODevice::WriteOnly) || !json.open(QIODevice::WriteOnly) )
+    {
+        QMessageBox::critical(this,tr("Profile Analysis"), tr("Cannot write profile to '%1'").arg(path) );
+        return;
+    }
+    txt.write( EbnfProfiler::toText( l, 100 ).toUtf8() );
+    json.write( EbnfProfiler::toJson( l ).toUtf8() );
+    QMessageBox::information(this,tr("Profile Analysis"), tr("Profile written to '%1'").arg(path) );
+}
+
 void MainWindow::onReloadKeywords()
 {
     ENABLED_IF(!d_edit->getPath().isEmpty());
@@ -711,6 +743,7 @@ void MainWindow::createMenus()
     Gui::AutoMenu* analyze = new Gui::AutoMenu( tr("Analyze"), this, true );
     //analyze->addCommand( "Calculate First Set", this, SLOT(onOutputFirstSet()) );
     analyze->addCommand( "Find ambiguities", this, SLOT(onFindAmbig() ), tr("CTRL+SHIFT+A"), true );
+    analyze->addCommand( "Profile Analysis", this, SLOT(onProfile()) );
 
     Gui::AutoMenu* generate = new Gui::AutoMenu( tr("Generate"), this, true );
     generate->addCommand( "Generate C++ Parser", this, SLOT(onGenCpp()) );
@@ -883,19 +916,7 @@ bool MainWindow::checkSaved(const QString& title)
 
 void MainWindow::loadTokMap()
 {
-    QFileInfo info(d_edit->getPath());
-    QFile in( info.absoluteDir().absoluteFilePath( info.completeBaseName() + ".tokmap") );
-    if( !in.open(QIODevice::ReadOnly) )
-        return;
-
-    GenUtils::TokMap m;
-    while( !in.atEnd() )
-    {
-        const QStringList pair = QString::fromUtf8( in.readLine().simplified() ).split(' ');
-        if( pair.size() == 2 )
-            m.insert(pair.first(),pair.last());
-    }
-    GenUtils::s_tokMap = m;
+    GenUtils::loadTokMap( d_edit->getPath() );
 }
 
 void MainWindow::closeEvent(QCloseEvent* event)
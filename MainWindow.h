@@ -62,6 +62,7 @@ protected slots:
     void onOutputFirstSet();
     void onUsedByDblClicked();
     void onFindAmbig();
+    void onProfile();
     void onReloadKeywords();
     void onAbout();
     void onDetailsDblClicked();
@@ -0,0 +1,90 @@
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SyntaxDelta.h"
+#include "EbnfSyntax.h"
+#include <algorithm>
+
+SyntaxDelta::SyntaxDelta(const EbnfSyntax* prev, const EbnfSyntax* cur):d_prevSyn(prev)
+{
+    const EbnfSyntax::OrderedDefs& order = cur->getOrderedDefs();
+    const quint32 count = order.size();
+    d_prev.fill( 0, count );
+    d_changed = QBitArray( count );
+    d_users.resize( count );
+
+    QHash<const Ast::Definition*,quint32> index;
+    index.reserve( count );
+    for( quint32 d = 0; d < count; d++ )
+        index.insert( order[d], d );
+
+    for( quint32 d = 0; d < count; d++ )
+    {
+        Ast::Definition* def = order[d];
+        const Ast::Definition* old = prev->getDef( def->d_tok.d_val );
+        if( old != 0 && old->doIgnore() == def->doIgnore() && ( old->d_node == 0 ) == ( def->d_node == 0 ) &&
+                ( def->d_node == 0 || isSame( old->d_node, def->d_node ) ) )
+        {
+            d_prev[d] = old;
+            d_unchanged.insert( old, def );
+        }else
+            d_changed.setBit( d );
+        foreach( const Ast::Node* use, def->d_usedBy )
+        {
+            const quint32 user = index.value( use->d_owner, FlatSyntax::Invalid );
+            if( user != FlatSyntax::Invalid )
+                d_users[d].append( user );
+        }
+        std::sort( d_users[d].begin(), d_users[d].end() );
+        d_users[d].erase( std::unique( d_users[d].begin(), d_users[d].end() ), d_users[d].end() );
+    }
+}
+
+Ast::Node* SyntaxDelta::map(const Ast::Node* prev) const
+{
+    // the same path of child indices from the root of the definition
+    QVector<int> path;
+    const Ast::Node* n = prev;
+    for( ; n->d_parent != 0; n = n->d_parent )
+        path.append( n->d_pos );
+    Ast::Definition* def = d_unchanged.value( n->d_owner );
+    if( def == 0 || n != n->d_owner->d_node )
+        return 0;
+    Ast::Node* res = def->d_node;
+    for( int i = path.size() - 1; i >= 0; i-- )
+        res = res->d_subs[path[i]];
+    return res;
+}
+
+bool SyntaxDelta::isSame(const Ast::Node* prev, const Ast::Node* cur)
+{
+    // the positions may differ, everything the analysis looks at must be equal
+    if( prev->d_type != cur->d_type || prev->d_quant != cur->d_quant || prev->isLiteral() != cur->isLiteral() ||
+            prev->d_tok.d_op != cur->d_tok.d_op || !( prev->d_tok.d_val == cur->d_tok.d_val ) ||
+            prev->d_subs.size() != cur->d_subs.size() || prev->doIgnore() != cur->doIgnore() ||
+            ( prev->d_def == 0 ) != ( cur->d_def == 0 ) ||
+            ( prev->d_def != 0 && ( prev->d_def->d_node == 0 ) != ( cur->d_def->d_node == 0 ) ) )
+        return false;
+    for( int i = 0; i < cur->d_subs.size(); i++ )
+    {
+        if( !isSame( prev->d_subs[i], cur->d_subs[i] ) )
+            return false;
+    }
+    return true;
+}
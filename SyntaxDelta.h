@@ -0,0 +1,54 @@
+#ifndef SYNTAXDELTA_H
+#define SYNTAXDELTA_H
+
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QBitArray>
+#include <QHash>
+#include <QVector>
+#include "FlatSyntax.h"
+
+class EbnfSyntax;
+
+// Differences of a syntax to an earlier version of the same text, by definition; the definitions are matched
+// by name. A definition is changed if its right hand side differs in structure, symbols, quantifiers or in
+// what is ignored or resolved. Together with the graph of the definitions using each other this tells which
+// facts of the earlier version still hold, see EbnfSyntax::finishSyntax.
+class SyntaxDelta
+{
+public:
+    SyntaxDelta( const EbnfSyntax* prev, const EbnfSyntax* cur ); // cur with resolved symbols and reachability
+    const EbnfSyntax* getPrevSyntax() const { return d_prevSyn; }
+    quint32 getDefCount() const { return d_prev.size(); } // the definitions of cur in the order of getOrderedDefs
+    const Ast::Definition* getPrev( quint32 d ) const { return d_prev[d]; } // 0 if new or changed
+    const QBitArray& getChanged() const { return d_changed; }
+    const FlatSyntax::Graph& getUsers() const { return d_users; } // by definition, the definitions using it
+    Ast::Node* map( const Ast::Node* prev ) const; // the same node in cur, 0 if its definition changed
+protected:
+    static bool isSame( const Ast::Node* prev, const Ast::Node* cur );
+private:
+    const EbnfSyntax* d_prevSyn;
+    QVector<const Ast::Definition*> d_prev;
+    QBitArray d_changed;
+    FlatSyntax::Graph d_users;
+    QHash<const Ast::Definition*,Ast::Definition*> d_unchanged; // prev -> cur
+};
+
+#endif // SYNTAXDELTA_H
@@ -0,0 +1,468 @@
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the EbnfStudio application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "EbnfParseJob.h"
+#include "EbnfBatch.h"
+#include "EbnfParser.h"
+#include "EbnfProfiler.h"
+#include "EbnfLexer.h"
+#include "FirstFollowSet.h"
+#include "EbnfAnalyzer.h"
+#include <QCoreApplication>
+#include <QThreadPool>
+#include <QTemporaryDir>
+#include <QBuffer>
+#include <QFile>
+#include <QDir>
+#include <QTextStream>
+#include <stdio.h>
+
+// The regression tests of the analysis pipeline; each test returns false and reports the reason on failure.
+// Run by "make check" of EbnfTest.pro.
+
+static QTextStream* s_err = 0;
+
+static bool fail( const QString& msg )
+{
+    *s_err << "    " << msg << endl;
+    return false;
+}
+
+static bool writeFile( const QString& path, const QByteArray& data )
+{
+    QFile f(path);
+    if( !f.open(QIODevice::WriteOnly) )
+        return false;
+    f.write(data);
+    return true;
+}
+
+static QByteArray readFile( const QString& path )
+{
+    QFile f(path);
+    if( !f.open(QIODevice::ReadOnly) )
+        return QByteArray();
+    return f.readAll();
+}
+
+static EbnfParseJob* runJob( const QByteArray& src, const EbnfSyntaxRef& prev = EbnfSyntaxRef() )
+{
+    EbnfToken::resetSymTbl();
+    EbnfParseJob* job = new EbnfParseJob( src, EbnfLexer::Keywords(), prev, 0 );
+    QThreadPool pool;
+    pool.start( job );
+    pool.waitForDone();
+    return job;
+}
+
+static bool testParseJob()
+{
+    QScopedPointer<EbnfParseJob> job( runJob( "A ::= 'a' B\nB ::= 'b' | C\nC ::= [ 'c' ] A\n" ) );
+    if( job->d_syn.constData() == 0 )
+        return fail( "the syntax without errors is not published" );
+    if( job->d_errs.getErrCount() != 0 )
+        return fail( "unexpected errors" );
+    return true;
+}
+
+static bool testUnresolvedReference()
+{
+    // used to crash in checkReachability because the buffered errors were not counted
+    QScopedPointer<EbnfParseJob> job( runJob( "A ::= 'a' B\nB ::= 'b' Undefined\nC ::= A\n" ) );
+    if( !job->isDone() )
+        return fail( "the job didn't finish" );
+    if( job->d_errs.getErrCount() == 0 )
+        return fail( "the unresolved reference is not counted as an error" );
+    bool found = false;
+    foreach( const EbnfErrors::Entry& e, job->d_errs.getBuffer() )
+    {
+        if( e.d_isErr && e.d_line == 2 && e.d_msg.contains("Undefined") )
+            found = true;
+    }
+    if( !found )
+        return fail( "the unresolved reference is not reported" );
+    if( job->d_syn.constData() == 0 || job->d_syn->isFinished() )
+        return fail( "the unfinished syntax is not published" );
+
+    // a forward reference typed halfway through keeps the navigation, and the next edit is analyzed in full
+    QScopedPointer<EbnfParseJob> first( runJob( "A ::= 'a' B\nB ::= 'b'\n" ) );
+    QScopedPointer<EbnfParseJob> typing( runJob( "A ::= 'a' B Cx\nB ::= 'b'\n", first->d_syn ) );
+    if( typing->d_syn.constData() == 0 )
+        return fail( "the syntax with a forward reference is not published" );
+    if( typing->d_syn->findSymbolBySourcePos( 1, 11 ) == 0 )
+        return fail( "the symbols of the unfinished syntax cannot be found" );
+    QScopedPointer<EbnfParseJob> done( runJob( "A ::= 'a' B Cx\nB ::= 'b'\nCx ::= 'c'\n", typing->d_syn ) );
+    if( done->d_syn.constData() == 0 || !done->d_syn->isFinished() || done->d_errs.getErrCount() != 0 )
+        return fail( "the syntax following an unfinished one is not finished" );
+    return true;
+}
+
+static bool testAnalysisErrors()
+{
+    // the issues of the analysis point to the nodes, so their syntax is published
+    QScopedPointer<EbnfParseJob> job( runJob( "A ::= B 'x' | 'y'\nB ::= A 'w'\n" ) );
+    if( job->d_errs.getErrCount() == 0 )
+        return fail( "the left recursion is not reported" );
+    if( job->d_syn.constData() == 0 )
+        return fail( "the analyzed syntax is not published" );
+    return true;
+}
+
+static EbnfSyntaxRef parseSyntax( const QByteArray& src, EbnfErrors* errs )
+{
+    QBuffer in;
+    in.setData( src );
+    in.open(QIODevice::ReadOnly);
+    EbnfLexer lex;
+    lex.setStream( &in );
+    EbnfParser p;
+    p.setErrors(errs);
+    if( p.parse( &lex ) )
+        return EbnfSyntaxRef( p.getSyntax() );
+    return EbnfSyntaxRef();
+}
+
+static bool testLeftRecursionPath()
+{
+    // the paths are kept by the id of the use, which is assigned when the syntax is flattened
+    EbnfToken::resetSymTbl();
+    EbnfErrors errs;
+    EbnfSyntaxRef syn = parseSyntax( "A ::= B 'x' | 'y'\nB ::= [ 'z' ] A 'w'\n", &errs );
+    if( syn.constData() == 0 || !syn->finishSyntax() )
+        return fail( "the grammar is not parsed" );
+    int uses = 0;
+    foreach( const Ast::Definition* d, syn->getOrderedDefs() )
+    {
+        foreach( const Ast::Node* use, d->d_usedBy )
+        {
+            if( !use->isLeftRecursive() )
+                continue;
+            uses++;
+            const Ast::NodeList path = syn->getPathToDef( use );
+            if( path.isEmpty() || path.last()->d_owner != use->d_def )
+                return fail( QString("no path from '%1' to its definition").arg(use->d_tok.d_val.toStr()) );
+        }
+    }
+    if( uses == 0 )
+        return fail( "the left recursion is not found" );
+    return true;
+}
+
+static bool testUnreachableTerminals()
+{
+    // the terminals only used by productions not reachable from the start don't get an id
+    EbnfToken::resetSymTbl();
+    EbnfErrors errs;
+    EbnfSyntaxRef syn = parseSyntax( "S ::= 'a' [ 'b' ] 'c'\nU ::= 'z' V | 'q'\nV ::= U 'y'\n", &errs );
+    if( syn.constData() == 0 || !syn->finishSyntax() )
+        return fail( "the grammar is not parsed" );
+    if( syn->getTermCount() != 3 )
+        return fail( QString("%1 terminals numbered instead of 3").arg( syn->getTermCount() ) );
+    if( syn->getSymId( EbnfToken::getSym("z") ) != EbnfSyntax::InvalidId )
+        return fail( "the terminal of a production not reachable is numbered" );
+    if( !syn->isTermId( syn->getSymId( EbnfToken::getSym("c") ) ) )
+        return fail( "the terminal of the start production is not numbered" );
+    return true;
+}
+
+static bool testPredicates()
+{
+    // the predicates accepted and rejected since the LL(k) sets are computed by FirstFollowSet and decided
+    // by LlkDfa; "was" marks the cases reported differently before
+    struct Case
+    {
+        const char* d_src;
+        bool d_effective;
+    };
+    static const Case cases[] = {
+        { "S ::= \\LL:2\\ 'a' 'b' | 'a' 'c'\n", true },
+        { "S ::= \\LL:2\\ 'a' 'b' | 'a' 'b' 'c'\n", false },
+        // the symbols by position intersect, the sequences don't
+        { "S ::= \\LL:2\\ ( 'a' 'b' | 'c' 'd' ) | ( 'a' 'd' | 'c' 'b' )\n", true },
+        // was rejected because the alternatives are shorter than k
+        { "S ::= \\LL:3\\ 'a' 'b' | 'a' 'c'\n", true },
+        // was accepted; the follow of the shorter alternative is 'c' as well
+        { "S ::= T 'c'\nT ::= \\LL:2\\ 'a' [ 'b' ] | 'a' 'c'\n", false },
+        { "S ::= [ \\LL:2\\ 'a' 'b' ] 'a' 'c'\n", true },
+        { "S ::= [ \\LL:2\\ 'a' 'b' ] 'a' 'b'\n", false },
+        // was rejected; skipping the option ends the input after 'a' or 'b'
+        { "S ::= [ \\LL:2\\ 'a' 'b' ] A\nA ::= 'a' | 'b'\n", true },
+    };
+    for( int i = 0; i < int(sizeof(cases) / sizeof(Case)); i++ )
+    {
+        EbnfToken::resetSymTbl();
+        EbnfErrors errs;
+        EbnfSyntaxRef syn = parseSyntax( cases[i].d_src, &errs );
+        if( syn.constData() == 0 || !syn->finishSyntax() )
+            return fail( QString("case %1 is not parsed").arg(i+1) );
+        FirstFollowSet set;
+        set.setSyntax( syn.data() );
+        EbnfAnalyzer::checkForAmbiguity( &set, &errs );
+        bool effective = true;
+        foreach( const EbnfErrors::Entry& e, errs.getErrors() )
+        {
+            if( e.d_msg.startsWith("predicate not effective") )
+                effective = false;
+        }
+        if( effective != cases[i].d_effective )
+            return fail( QString("the predicate of case %1 is %2").arg(i+1)
+                         .arg( effective ? "accepted" : "rejected" ) );
+    }
+    return true;
+}
+
+static bool testTokMapPerGrammar()
+{
+    // the .tokmap of a grammar must not be applied to the next grammar which has none
+    QTemporaryDir tmp;
+    if( !tmp.isValid() )
+        return fail( "cannot create a temporary directory" );
+    QDir dir( tmp.path() );
+    dir.mkpath( dir.absoluteFilePath("a") );
+    dir.mkpath( dir.absoluteFilePath("b") );
+    const QByteArray src = "Expr ::= ident { '+' ident }\nident ::=\n";
+    if( !writeFile( dir.absoluteFilePath("a/a.ebnf"), src ) ||
+            !writeFile( dir.absoluteFilePath("a/a.tokmap"), "+ Add\n" ) ||
+            !writeFile( dir.absoluteFilePath("b/b.ebnf"), src ) )
+        return fail( "cannot write the grammars" );
+    EbnfBatch batch;
+    batch.setGenerators( EbnfBatch::GenTt );
+    const EbnfBatch::Result a = batch.process( dir.absoluteFilePath("a/a.ebnf") );
+    const EbnfBatch::Result b = batch.process( dir.absoluteFilePath("b/b.ebnf") );
+    if( a.hasErrors() || b.hasErrors() || !a.d_generated || !b.d_generated )
+        return fail( "the token types are not generated" );
+    if( !readFile( dir.absoluteFilePath("a/TokenType.h") ).contains("Tok_Add") )
+        return fail( "the .tokmap is not applied" );
+    if( readFile( dir.absoluteFilePath("b/TokenType.h") ).contains("Tok_Add") )
+        return fail( "the .tokmap of the previous grammar is applied" );
+    return true;
+}
+
+static bool testProfilerJson()
+{
+    // the details are grammar text and may contain control characters
+    EbnfProfiler::Entry e;
+    e.d_phase = "lexer";
+    e.d_detail = "a\"b\\c\n\x01";
+    const QString json = EbnfProfiler::toJson( EbnfProfiler::Entries() << e );
+    if( !json.contains( "\"a\\\"b\\\\c\\u000a\\u0001\"" ) )
+        return fail( "the detail is not escaped: " + json );
+    return true;
+}
+
+static quint32 lexerCalls( const EbnfProfiler::Entries& entries )
+{
+    foreach( const EbnfProfiler::Entry& e, entries )
+    {
+        if( e.d_phase == "lexer" && e.d_detail.isEmpty() )
+            return e.d_calls;
+    }
+    return 0;
+}
+
+static bool testProfilerSites()
+{
+    // the per token sites are summed up by the entry of their phase
+    EbnfProfiler::reset();
+    EbnfProfiler::setEnabled(true);
+    EbnfToken::resetSymTbl();
+    EbnfErrors errs;
+    parseSyntax( "A ::= 'a' B\nB ::= 'b'\n", &errs );
+    EbnfProfiler::setEnabled(false);
+    if( lexerCalls( EbnfProfiler::getEntries() ) == 0 )
+        return fail( "the lexer calls are not counted" );
+
+    // the counters of the parse jobs are read and reset while the jobs are running
+    EbnfProfiler::reset();
+    EbnfProfiler::setEnabled(true);
+    QList<EbnfParseJob*> jobs;
+    QThreadPool pool;
+    for( int i = 0; i < 4; i++ )
+    {
+        jobs.append( new EbnfParseJob( "A ::= 'a' B { C }\nB ::= 'b' | C\nC ::= [ 'c' ] 'd'\n",
+                                       EbnfLexer::Keywords(), EbnfSyntaxRef(), 0 ) );
+        pool.start( jobs.last() );
+    }
+    quint32 calls = 0;
+    while( !pool.waitForDone(0) )
+    {
+        calls += lexerCalls( EbnfProfiler::getEntries() );
+        EbnfProfiler::reset();
+    }
+    calls += lexerCalls( EbnfProfiler::getEntries() );
+    EbnfProfiler::setEnabled(false);
+    EbnfProfiler::reset();
+    qDeleteAll( jobs );
+    if( calls == 0 )
+        return fail( "the lexer calls of the parse jobs are not counted" );
+    return true;
+}
+
+static bool testLlkEnds()
+{
+    // the sequences of length 31 are the last ones representable with k = 32
+    FirstFollowSet::LlkSet a(32), b(32);
+    for( int i = 0; i < 32; i++ )
+    {
+        a.d_pos[i] = b.d_pos[i] = Ast::BitSet(64);
+        a.d_pos[i].setBit( i );
+        b.d_pos[i].setBit( i == 31 ? 63 : i );
+    }
+    a.d_ends = b.d_ends = quint32(1) << 31;
+    if( !a.intersects(b) )
+        return fail( "the sequences of length 31 don't intersect" );
+    b.d_ends = 1;
+    if( a.intersects(b) )
+        return fail( "the sequences of different length intersect" );
+    return true;
+}
+
+// lexes the text round by round in a worker thread; each round adds new identifiers which the other threads
+// intern at the same time. The symbols are kept alive by a generation like by an EbnfSyntax.
+class LexJob : public QRunnable
+{
+public:
+    LexJob( const QByteArray& src, quint32 rounds ):d_src(src),d_rounds(rounds),d_tokens(0),d_unstable(0)
+    {
+        setAutoDelete(false);
+        d_gen = EbnfToken::acquireSymGeneration();
+    }
+    ~LexJob() { EbnfToken::releaseSymGeneration(d_gen); }
+    void run()
+    {
+        for( quint32 r = 0; r < d_rounds; r++ )
+        {
+            QByteArray text = d_src + "\nR" + QByteArray::number(r) + " ::=";
+            for( int i = 0; i < 200; i++ )
+                text += " r" + QByteArray::number(r) + "_" + QByteArray::number(i);
+            QBuffer in;
+            in.setData( text );
+            in.open(QIODevice::ReadOnly);
+            EbnfLexer lex;
+            lex.setStream( &in );
+            for( EbnfToken t = lex.nextToken(); t.isValid(); t = lex.nextToken() )
+            {
+                if( t.d_val.isEmpty() )
+                    continue;
+                d_tokens++;
+                const char*& sym = d_syms[t.d_val.toBa()];
+                if( sym == 0 )
+                    sym = t.d_val.data();
+                else if( sym != t.d_val.data() )
+                    d_unstable++;
+            }
+        }
+    }
+    QByteArray d_src;
+    quint32 d_rounds;
+    quint32 d_gen;
+    quint32 d_tokens;
+    quint32 d_unstable; // a string interned twice while its symbol was alive
+    QHash<QByteArray,const char*> d_syms;
+};
+
+static bool testSymTblStress()
+{
+    // several lexers run in parallel while the symbol table is reset again and again; a string must be the
+    // same symbol in all threads and afterwards
+    QByteArray src;
+    for( int i = 0; i < 200; i++ )
+        src += "P" + QByteArray::number(i) + " ::= p" + QByteArray::number(i) + " 'x' // comment " +
+                QByteArray::number(i) + "\n";
+    EbnfToken::resetSymTbl();
+    const EbnfToken::SymPoolStats before = EbnfToken::getSymPoolStats();
+    QList<LexJob*> jobs;
+    for( int i = 0; i < 4; i++ )
+        jobs.append( new LexJob( src, 20 ) );
+    QThreadPool pool;
+    pool.setMaxThreadCount( jobs.size() );
+    foreach( LexJob* j, jobs )
+        pool.start( j );
+    while( !pool.waitForDone(1) )
+        EbnfToken::resetSymTbl();
+    quint32 tokens = 0;
+    quint32 violations = 0;
+    foreach( LexJob* j, jobs )
+    {
+        tokens += j->d_tokens;
+        violations += j->d_unstable;
+        QHash<QByteArray,const char*>::const_iterator i;
+        for( i = j->d_syms.begin(); i != j->d_syms.end(); ++i )
+        {
+            if( jobs.first()->d_syms.value( i.key() ) != i.value() || EbnfToken::getSym( i.key() ).data() != i.value() )
+                violations++;
+        }
+    }
+    qDeleteAll( jobs );
+    EbnfToken::resetSymTbl();
+    EbnfToken::resetSymTbl();
+    const EbnfToken::SymPoolStats after = EbnfToken::getSymPoolStats();
+    if( tokens == 0 )
+        return fail( "nothing was lexed" );
+    if( violations != 0 )
+        return fail( QString("a string was interned as different symbols %1 times").arg(violations) );
+    if( after.d_count > before.d_count )
+        return fail( QString("%1 symbols are not reclaimed").arg( after.d_count - before.d_count ) );
+    return true;
+}
+
+struct Test
+{
+    const char* d_name;
+    bool (*d_run)();
+};
+
+static const Test s_tests[] = {
+    { "parseJob", testParseJob },
+    { "unresolvedReference", testUnresolvedReference },
+    { "analysisErrors", testAnalysisErrors },
+    { "tokMapPerGrammar", testTokMapPerGrammar },
+    { "leftRecursionPath", testLeftRecursionPath },
+    { "unreachableTerminals", testUnreachableTerminals },
+    { "profilerJson", testProfilerJson },
+    { "profilerSites", testProfilerSites },
+    { "llkEnds", testLlkEnds },
+    { "predicates", testPredicates },
+    { "symTblStress", testSymTblStress },
+};
+static const int s_testCount = sizeof(s_tests) / sizeof(Test);
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    s_err = &err;
+
+    const QStringList args = a.arguments();
+    int failed = 0;
+    for( int i = 0; i < s_testCount; i++ )
+    {
+        if( args.size() > 1 && !args.contains( s_tests[i].d_name ) )
+            continue;
+        out << s_tests[i].d_name << endl;
+        if( !s_tests[i].d_run() )
+        {
+            err << "FAIL " << s_tests[i].d_name << endl;
+            failed++;
+        }
+    }
+    out << ( failed == 0 ? "all tests passed" : QString("%1 tests failed").arg(failed) ) << endl;
+    return failed == 0 ? 0 : 1;
+}